@@ -0,0 +1,110 @@
+# Embed OpenCL kernel sources and binaries into a target as static data
+#
+#   include(EmbedKernels)
+#   easyopencl_embed_kernels(<variable>
+#                            [FUNCTION <name>]
+#                            SOURCES <file.cl/.clh>...
+#                            [BINARIES <file.bin>...])
+#   add_executable(app main.cpp ${<variable>})
+#
+# Sets <variable> to a generated .cpp file which registers the files with
+# the KernelRegistry under their file name, load() then finds the kernel
+# without reading the file system. Binaries are built for one device, eg.
+# written by EasyOpenCL::writeBinary("squarefloat", "squarefloat.bin"); a
+# device which rejects them falls back to the source.
+#
+# The files register themselves when the program starts. With FUNCTION they
+# register when the function of that name is called instead, for static
+# libraries in which nothing else refers to the generated file.
+
+if(NOT CMAKE_SCRIPT_MODE_FILE)
+
+include(CMakeParseArguments)
+set(EASYOPENCL_EMBED_SCRIPT ${CMAKE_CURRENT_LIST_FILE})
+
+function(easyopencl_embed_kernels variable)
+  cmake_parse_arguments(EMBED "" "FUNCTION" "SOURCES;BINARIES" ${ARGN})
+
+  set(files "")
+  foreach(file ${EMBED_SOURCES} ${EMBED_BINARIES})
+    get_filename_component(file ${file} ABSOLUTE)
+    list(APPEND files ${file})
+  endforeach()
+
+  set(binaries "")
+  foreach(file ${EMBED_BINARIES})
+    get_filename_component(name ${file} NAME)
+    list(APPEND binaries ${name})
+  endforeach()
+
+  # Lists are passed with '|' as separator, a ';' would split the argument
+  string(REPLACE ";" "|" fileList "${files}")
+  string(REPLACE ";" "|" binaryList "${binaries}")
+
+  set(output ${CMAKE_CURRENT_BINARY_DIR}/${variable}.cpp)
+  add_custom_command(OUTPUT ${output}
+    COMMAND ${CMAKE_COMMAND} -DOUTPUT=${output} "-DFILES=${fileList}" "-DBINARIES=${binaryList}"
+            "-DFUNCTION=${EMBED_FUNCTION}" -P ${EASYOPENCL_EMBED_SCRIPT}
+    DEPENDS ${files} ${EASYOPENCL_EMBED_SCRIPT}
+    COMMENT "Embedding OpenCL kernels in ${variable}.cpp"
+    VERBATIM)
+
+  set(${variable} ${output} PARENT_SCOPE)
+endfunction()
+
+else()
+
+# Script mode: write OUTPUT from FILES
+string(REPLACE "|" ";" FILES "${FILES}")
+string(REPLACE "|" ";" BINARIES "${BINARIES}")
+
+# 16 bytes per line (no {n} repetition in CMake regular expressions)
+set(line "")
+foreach(i RANGE 15)
+  set(line "${line}0x[0-9a-f][0-9a-f],")
+endforeach()
+
+set(data "")
+set(entries "")
+set(index 0)
+
+foreach(file ${FILES})
+  get_filename_component(name ${file} NAME)
+  file(READ ${file} hex HEX)
+  string(LENGTH "${hex}" hexLength)
+  math(EXPR size "${hexLength} / 2")
+
+  # The array is terminated so sources are C strings
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+  string(REGEX REPLACE "(${line})" "\\1\n  " bytes "${bytes}")
+
+  list(FIND BINARIES ${name} binary)
+  if(binary EQUAL -1)
+    set(binary false)
+  else()
+    set(binary true)
+  endif()
+
+  set(data "${data}static const unsigned char data${index}[] = {\n  ${bytes}0x00\n};\n\n")
+  set(entries "${entries}  { \"${name}\", data${index}, ${size}, ${binary} },\n")
+  math(EXPR index "${index} + 1")
+endforeach()
+
+if(FUNCTION)
+  set(registration "void ${FUNCTION}() {\n  KernelRegistry::add(kernels, sizeof(kernels) / sizeof(kernels[0]));\n}\n")
+else()
+  set(registration "static KernelRegistration registration(kernels, sizeof(kernels) / sizeof(kernels[0]));\n")
+endif()
+
+file(WRITE ${OUTPUT}.tmp
+  "// Generated by EmbedKernels.cmake, do not edit\n"
+  "#include \"kernelregistry.h\"\n\n"
+  "${data}"
+  "static const EmbeddedKernel kernels[] = {\n${entries}};\n\n"
+  "${registration}")
+
+# Only touch the output when it changed, to avoid recompiling
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${OUTPUT}.tmp ${OUTPUT})
+file(REMOVE ${OUTPUT}.tmp)
+
+endif()
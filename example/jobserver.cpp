@@ -0,0 +1,57 @@
+#include "easyopencl.h"
+#include "jobserver.h"
+
+#include <csignal>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// example/jobserver            serves jobs on /tmp/easyopencl.sock until Ctrl-C
+// example/jobserver --client   submits a few jobs to a running server
+
+static JobServer<float> * server = NULL;
+
+static void shutdown(int) {
+  if (server) {
+    server->stop();
+  }
+}
+
+int main(int argc, char* argv[]) {
+
+  std::string socketPath = "/tmp/easyopencl.sock";
+
+  try {
+    if (argc > 1 && std::string(argv[1]) == "--client") {
+      JobClient<float> client(socketPath);
+
+      for (int job = 0; job < 4; job++) {
+        std::vector<float> input { 1.0f + job, 2.0f, 3.0f };
+        std::vector<float> output = client.run({ "squarefloat", "squarefloat" }, input);
+
+        for (float value : output) {
+          std::cout << value << " ";
+        }
+        std::cout << std::endl;
+      }
+      return 0;
+    }
+
+    EasyOpenCL<float> framework (NO_DEBUG);
+    JobServer<float> jobs(framework, socketPath);
+    jobs.setBatchWindow(std::chrono::milliseconds(2));
+
+    server = &jobs;
+    signal(SIGINT, shutdown);
+
+    std::cout << "Serving on " << socketPath << std::endl;
+    jobs.serve();
+
+    std::cout << jobs.getJobCount() << " jobs in " << jobs.getBatchCount() << " batches" << std::endl;
+    server = NULL;
+  }
+  catch (std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+  }
+}
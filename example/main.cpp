@@ -1,6 +1,7 @@
 #include "easyopencl.h"
 #include "mac.clh"
 
+#include <algorithm>
 #include <iostream>
 #include <exception>
 #include <vector>
@@ -12,6 +13,7 @@ int main() {
 
   try {
     EasyOpenCL<float> framework (false);
+    framework.enableProfiling();
 
     // input:   -
     // output:  the index as floating point value
@@ -60,6 +62,121 @@ int main() {
 
     aggregate.evaluate();
     aggregate.showBuffers();
+
+    // Where did the device time go? Render with: dot -Tsvg graph.dot -o graph.svg
+    framework.analyse(aggregate).writeDot("graph.dot");
+
+    // Random numbers generated on the device, the same for every run with seed 42
+    auto& noise = framework.loadRandom("noise", initData.size(), Distribution::Normal, 42);
+    noise.evaluate();
+    noise.showBuffer(Random::Output);
+
+    // A sparse matrix (tridiagonal, -1 2 -1) times a vector
+    std::vector<cl_uint> rowIndex, columnIndex;
+    std::vector<float> entries;
+    for (uint i = 0; i < initData.size(); i++) {
+      for (uint j = (i ? i - 1 : 0); j <= std::min(i + 1, (uint)initData.size() - 1); j++) {
+        rowIndex.push_back(i);
+        columnIndex.push_back(j);
+        entries.push_back(i == j ? 2.0f : -1.0f);
+      }
+    }
+    auto laplacian = SparseMatrix<float>::fromTriplets(initData.size(), initData.size(), rowIndex, columnIndex, entries);
+
+    auto& spmv = framework.loadSpMV("laplacian", laplacian, SparseFormat::SlicedELL);
+    spmv.bindInput(SpMV::X, initData);
+    spmv.evaluate();
+    spmv.showBuffer(SpMV::Y);
+
+    // A rectangular one, the differences of neighbours with one row more than
+    // columns: y keeps its length when it is linked on after x was bound
+    rowIndex.clear();
+    columnIndex.clear();
+    entries.clear();
+    for (uint i = 0; i <= initData.size(); i++) {
+      if (i > 0) {
+        rowIndex.push_back(i);
+        columnIndex.push_back(i - 1);
+        entries.push_back(-1.0f);
+      }
+      if (i < initData.size()) {
+        rowIndex.push_back(i);
+        columnIndex.push_back(i);
+        entries.push_back(1.0f);
+      }
+    }
+    auto differences = SparseMatrix<float>::fromTriplets(initData.size() + 1, initData.size(), rowIndex, columnIndex, entries);
+
+    auto& gradient = framework.loadSpMV("gradient", differences, SparseFormat::CSR);
+    gradient.bindInput(SpMV::X, initData);
+
+    // input:   the differences
+    // output:  their squares
+    auto& energy = framework.load("energy", "squarefloat");
+    framework.link(gradient, energy, {{SpMV::Y, 0}});
+    energy.bindOutput(1, differences.getRows());
+    energy.setWorkSize(differences.getRows());
+    energy.evaluate();
+    energy.showBuffer(1);
+
+    // Particles as a structure of arrays, every field its own buffer
+    struct Particle { cl_float4 position; cl_float4 velocity; cl_float mass; };
+    std::vector<Particle> particles;
+    for (uint i = 0; i < initData.size(); i++) {
+      particles.push_back(Particle { {{ (float)i, 0, 0, 1 }}, {{ 0, 1, 0, 0 }}, initData[i] });
+    }
+
+    // input:   the positions and the velocities of the particles
+    // output:  the positions after dt
+    auto& move = framework.load("movefloat");
+    move.bindStructs(0, particles, &Particle::position, &Particle::velocity);
+    move.bindStructOutput(2, particles.size(), &Particle::position);
+    move.bindScalar(3, 0.5f);
+    move.evaluate();
+
+    for (Particle& p : move.getStructs(2, &Particle::position)) {
+      std::cout << "(" << p.position.s[0] << ", " << p.position.s[1] << ") ";
+    }
+    std::cout << std::endl;
+
+    // A hot kernel rebuilt with its scalar as constants after 10 launches
+    // with the same values, mult and add are folded into the code
+    auto& hotMac = framework.load("hotmac", "macfloat");
+    hotMac.setSpecialization(10);
+    hotMac.bindInput(0, initData);
+    hotMac.bindOutput(1);
+    hotMac.bindScalar<MAC>(2, macdata);
+    for (int i = 0; i < 20; i++) {
+      hotMac.evaluate();
+    }
+    std::cout << "hotmac specialized: " << hotMac.isSpecialized() << std::endl;
+    hotMac.showBuffer(1);
+
+    // Pointer-linked data without copies, on devices with shared virtual memory
+    if (framework.supportsSVM()) {
+      struct Node { float value; Node* next; };
+
+      std::vector<Node, SVMAllocator<Node>> nodes(initData.size(), Node(), framework.svmAllocator<Node>());
+      std::vector<float, SVMAllocator<float>> sums(initData.size(), 0.0f, framework.svmAllocator<float>());
+      for (uint i = 0; i < nodes.size(); i++) {
+        nodes[i] = Node { initData[i], i + 1 < nodes.size() ? &nodes[i + 1] : NULL };
+      }
+
+      // input:   list nodes
+      // output:  the sum of the list from every node on
+      auto& sumList = framework.load("sumlistfloat");
+      sumList.bindSVM(0, nodes);
+      sumList.bindSVM(1, sums);
+      sumList.evaluate();
+
+      for (float sum : sums) {
+        std::cout << sum << " ";
+      }
+      std::cout << std::endl;
+    }
+
+    // Where did the host time go?
+    std::cout << framework.getTelemetry().report();
   }
   catch (std::exception& e) { std::cerr << "Error: " << e.what() << std::endl; }
 
@@ -0,0 +1,369 @@
+#include "easyopencl.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// A BVH ray tracer as a benchmark: the hierarchy is built on the host,
+// flattened into two arrays and traversed per pixel (kernels/bvh.clh).
+// Traversal is irregular, neighbouring rays read different nodes, which the
+// simple elementwise kernels never show.
+
+// The layouts of kernels/bvh.clh
+struct Node {
+  cl_float min[3];
+  cl_uint leftFirst;
+  cl_float max[3];
+  cl_uint count;
+};
+
+struct Triangle {
+  cl_float v[9];
+};
+
+struct Scene {
+  cl_float origin[3];
+  cl_float lowerLeft[3];
+  cl_float horizontal[3];
+  cl_float vertical[3];
+  cl_float light[3];
+};
+
+// Hits of traceprimary, image of traceshadow
+const uint HITS = 2;
+const uint IMAGE = 3;
+
+const uint WIDTH = 1024;
+const uint HEIGHT = 768;
+const uint RUNS = 5;
+
+/*******************************************************/
+//  BUILDING THE HIERARCHY
+/*******************************************************/
+struct Primitive {
+  Triangle triangle;
+  float centroid[3];
+};
+
+struct Bounds {
+  float min[3] = { INFINITY, INFINITY, INFINITY };
+  float max[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+  void grow(const float* p) {
+    for (int a = 0; a < 3; a++) {
+      min[a] = std::min(min[a], p[a]);
+      max[a] = std::max(max[a], p[a]);
+    }
+  }
+  void grow(const Triangle& t) { grow(&t.v[0]); grow(&t.v[3]); grow(&t.v[6]); }
+
+  float area() const {
+    float d[3] = { max[0] - min[0], max[1] - min[1], max[2] - min[2] };
+    return d[0] < 0 ? 0.0f : 2.0f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+  }
+};
+
+// Leaves hold up to LEAF_SIZE triangles, more only when splitting costs more
+const uint LEAF_SIZE = 4;
+const uint MAX_LEAF_SIZE = 16;
+const uint BINS = 12;
+
+// Below this depth the SAH gives way to median splits, which keeps the depth
+// within the traversal stack (BVH_STACK) for any scene
+const uint SAH_DEPTH = 32;
+
+static uint build(std::vector<Node>& nodes, std::vector<Primitive>& primitives, uint first, uint count, uint depth) {
+
+  uint index = nodes.size();
+  nodes.push_back(Node());
+
+  Bounds bounds, centroids;
+  for (uint i = first; i < first + count; i++) {
+    bounds.grow(primitives[i].triangle);
+    centroids.grow(primitives[i].centroid);
+  }
+  std::copy(bounds.min, bounds.min + 3, nodes[index].min);
+  std::copy(bounds.max, bounds.max + 3, nodes[index].max);
+
+  int axis = 0;
+  for (int a = 1; a < 3; a++) {
+    if (centroids.max[a] - centroids.min[a] > centroids.max[axis] - centroids.min[axis]) {
+      axis = a;
+    }
+  }
+  float extent = centroids.max[axis] - centroids.min[axis];
+
+  if (count <= LEAF_SIZE || extent <= 0.0f) {
+    nodes[index].leftFirst = first;
+    nodes[index].count = count;
+    return index;
+  }
+
+  uint middle = 0;
+
+  if (depth < SAH_DEPTH) {
+    // Binned surface area heuristic along the longest axis of the centroids
+    Bounds binBounds[BINS];
+    uint binCounts[BINS] = { 0 };
+    auto binOf = [&](const Primitive& p) {
+      return std::min(BINS - 1, (uint)(BINS * (p.centroid[axis] - centroids.min[axis]) / extent));
+    };
+    for (uint i = first; i < first + count; i++) {
+      uint bin = binOf(primitives[i]);
+      binCounts[bin]++;
+      binBounds[bin].grow(primitives[i].triangle);
+    }
+
+    float leftArea[BINS], rightArea[BINS];
+    uint leftCount[BINS], rightCount[BINS];
+    Bounds left, right;
+    uint leftSum = 0, rightSum = 0;
+    for (uint b = 0; b < BINS - 1; b++) {
+      leftSum += binCounts[b];
+      left.grow(binBounds[b].min); left.grow(binBounds[b].max);
+      leftCount[b] = leftSum;
+      leftArea[b] = left.area();
+
+      uint r = BINS - 1 - b;
+      rightSum += binCounts[r];
+      right.grow(binBounds[r].min); right.grow(binBounds[r].max);
+      rightCount[r - 1] = rightSum;
+      rightArea[r - 1] = right.area();
+    }
+
+    uint bestSplit = 0;
+    float bestCost = INFINITY;
+    for (uint b = 0; b < BINS - 1; b++) {
+      float cost = leftCount[b] * leftArea[b] + rightCount[b] * rightArea[b];
+      if (leftCount[b] && rightCount[b] && cost < bestCost) {
+        bestCost = cost;
+        bestSplit = b;
+      }
+    }
+
+    if (bestCost / bounds.area() >= count && count <= MAX_LEAF_SIZE) {
+      nodes[index].leftFirst = first;
+      nodes[index].count = count;
+      return index;
+    }
+
+    if (bestCost < INFINITY) {
+      auto split = std::partition(primitives.begin() + first, primitives.begin() + first + count
+        , [&](const Primitive& p) { return binOf(p) <= bestSplit; });
+      middle = split - primitives.begin();
+    }
+  }
+
+  // Median split, both halves are never empty
+  if (middle <= first || middle >= first + count) {
+    middle = first + count / 2;
+    std::nth_element(primitives.begin() + first, primitives.begin() + middle, primitives.begin() + first + count
+      , [&](const Primitive& a, const Primitive& b) { return a.centroid[axis] < b.centroid[axis]; });
+  }
+
+  // The left child follows its parent, the right one is linked
+  build(nodes, primitives, first, middle - first, depth + 1);
+  uint rightChild = build(nodes, primitives, middle, first + count - middle, depth + 1);
+  nodes[index].leftFirst = rightChild;
+  nodes[index].count = 0;
+  return index;
+}
+
+/**
+ * Build the hierarchy
+ *
+ * Input:   std::vector<Triangle>& triangles  - reordered so leaves are contiguous
+ *
+ * Output:  std::vector<Node>  - the nodes, depth first, the root at 0
+ */
+static std::vector<Node> buildBvh(std::vector<Triangle>& triangles) {
+
+  std::vector<Primitive> primitives(triangles.size());
+  for (uint i = 0; i < triangles.size(); i++) {
+    primitives[i].triangle = triangles[i];
+    for (int a = 0; a < 3; a++) {
+      primitives[i].centroid[a] = (triangles[i].v[a] + triangles[i].v[3 + a] + triangles[i].v[6 + a]) / 3.0f;
+    }
+  }
+
+  std::vector<Node> nodes;
+  nodes.reserve(2 * triangles.size());
+  build(nodes, primitives, 0, primitives.size(), 0);
+
+  for (uint i = 0; i < triangles.size(); i++) {
+    triangles[i] = primitives[i].triangle;
+  }
+  return nodes;
+}
+
+/*******************************************************/
+//  THE SCENE
+/*******************************************************/
+static Triangle triangle(const float* a, const float* b, const float* c) {
+  return Triangle { { a[0], a[1], a[2], b[0], b[1], b[2], c[0], c[1], c[2] } };
+}
+
+// A ground plane with randomly placed tessellated spheres of 256 triangles
+static std::vector<Triangle> generateScene(uint spheres) {
+
+  const int RINGS = 8;
+  const int SEGMENTS = 16;
+
+  std::vector<Triangle> triangles;
+  const float ground[4][3] = { { -50, 0, -50 }, { 50, 0, -50 }, { 50, 0, 50 }, { -50, 0, 50 } };
+  triangles.push_back(triangle(ground[0], ground[1], ground[2]));
+  triangles.push_back(triangle(ground[0], ground[2], ground[3]));
+
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+  float radius = std::min(1.0f, 6.0f / std::sqrt((float)spheres));
+
+  for (uint s = 0; s < spheres; s++) {
+    float center[3] = { position(generator), radius * (1.0f + std::abs(position(generator)) / 5.0f), position(generator) };
+
+    auto point = [&](int ring, int segment, float* p) {
+      float theta = (float)M_PI * ring / RINGS;
+      float phi = 2.0f * (float)M_PI * segment / SEGMENTS;
+      p[0] = center[0] + radius * std::sin(theta) * std::cos(phi);
+      p[1] = center[1] + radius * std::cos(theta);
+      p[2] = center[2] + radius * std::sin(theta) * std::sin(phi);
+    };
+
+    for (int ring = 0; ring < RINGS; ring++) {
+      for (int segment = 0; segment < SEGMENTS; segment++) {
+        float a[3], b[3], c[3], d[3];
+        point(ring, segment, a);
+        point(ring + 1, segment, b);
+        point(ring + 1, segment + 1, c);
+        point(ring, segment + 1, d);
+        triangles.push_back(triangle(a, b, c));
+        triangles.push_back(triangle(a, c, d));
+      }
+    }
+  }
+
+  return triangles;
+}
+
+// Looking at the middle of the scene from above and behind
+static Scene camera(uint width, uint height) {
+
+  const float eye[3] = { 0.0f, 8.0f, 18.0f };
+  const float target[3] = { 0.0f, 0.0f, 0.0f };
+  const float fieldOfView = 60.0f * (float)M_PI / 180.0f;
+
+  auto normalize = [](float* v) {
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for (int a = 0; a < 3; a++) v[a] /= length;
+  };
+
+  float forward[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+  normalize(forward);
+  float right[3] = { -forward[2], 0.0f, forward[0] };   // forward x up
+  normalize(right);
+  float up[3] = { right[1] * forward[2] - right[2] * forward[1], right[2] * forward[0] - right[0] * forward[2]
+                , right[0] * forward[1] - right[1] * forward[0] };
+
+  float halfHeight = std::tan(fieldOfView / 2.0f);
+  float halfWidth = halfHeight * width / height;
+
+  Scene scene;
+  for (int a = 0; a < 3; a++) {
+    scene.origin[a] = eye[a];
+    scene.horizontal[a] = 2.0f * halfWidth * right[a];
+    scene.vertical[a] = 2.0f * halfHeight * up[a];
+    scene.lowerLeft[a] = eye[a] + forward[a] - halfWidth * right[a] - halfHeight * up[a];
+  }
+  scene.light[0] = 6.0f; scene.light[1] = 20.0f; scene.light[2] = 8.0f;
+  return scene;
+}
+
+static void writeImage(std::string fileName, const std::vector<float>& image, uint width, uint height) {
+  std::ofstream file(fileName, std::ios::binary);
+  file << "P5\n" << width << " " << height << "\n255\n";
+  for (float value : image) {
+    file.put((char)(unsigned char)std::min(255.0f, value * 255.0f));
+  }
+}
+
+/*******************************************************/
+//  BENCHMARK
+/*******************************************************/
+int main() {
+
+  try {
+    EasyOpenCL<float> framework (NO_DEBUG);
+    framework.enableProfiling();
+
+    Scene scene = camera(WIDTH, HEIGHT);
+
+    std::cout << std::setw(10) << "triangles" << std::setw(10) << "nodes" << std::setw(12) << "build ms"
+              << std::setw(16) << "primary Mray/s" << std::setw(16) << "shadow Mray/s" << std::endl;
+
+    for (uint spheres : { 16, 256, 4096 }) {
+      std::vector<Triangle> triangles = generateScene(spheres);
+
+      auto start = std::chrono::steady_clock::now();
+      std::vector<Node> nodes = buildBvh(triangles);
+      double buildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+      // nodes:      the hierarchy
+      // triangles:  in the order of the leaves
+      // output:     hit points, then the shaded image
+      std::string size = std::to_string(triangles.size());
+      auto& primary = framework.load("primary" + size, "traceprimary");
+      auto& shadow = framework.load("shadow" + size, "traceshadow");
+
+      primary.bindArray(0, nodes);
+      primary.bindArray(1, triangles);
+      primary.bindScalar(3, scene);
+      primary.setWorkSize({{ WIDTH, HEIGHT }});
+
+      // The shadow rays walk the same hierarchy, without another upload.
+      // Promises share the arrays of the primary kernel, a link would
+      // replace them by outputs.
+      shadow.bindPromise(primary, 0, 0);
+      shadow.bindPromise(primary, 1, 1);
+      framework.link(primary, shadow, 4 * WIDTH * HEIGHT, {{HITS, HITS}});
+      shadow.bindOutput(IMAGE, WIDTH * HEIGHT);
+      shadow.bindScalar(4, scene);
+      shadow.setWorkSize({{ WIDTH, HEIGHT }});
+
+      // The best of a few frames, in device time
+      cl_ulong primaryTime = -1;
+      cl_ulong shadowTime = -1;
+      for (uint run = 0; run < RUNS; run++) {
+        primary.evaluate();
+        shadow.evaluate();
+        primaryTime = std::min(primaryTime, primary.getExecutionTime());
+        shadowTime = std::min(shadowTime, shadow.getExecutionTime());
+      }
+
+      // Only lit hits cast a shadow ray
+      std::vector<float> hits = primary.getBuffer(HITS);
+      uint shadowRays = 0;
+      for (uint i = 3; i < hits.size(); i += 4) {
+        shadowRays += hits[i] > 0.0f;
+      }
+
+      std::cout << std::setw(10) << triangles.size() << std::setw(10) << nodes.size()
+                << std::setw(12) << std::fixed << std::setprecision(1) << buildTime
+                << std::setw(16) << (double)WIDTH * HEIGHT / std::max<cl_ulong>(primaryTime, 1) * 1e3
+                << std::setw(16) << (double)shadowRays / std::max<cl_ulong>(shadowTime, 1) * 1e3 << std::endl;
+
+      writeImage("raytracer" + size + ".pgm", shadow.getBuffer(IMAGE), WIDTH, HEIGHT);
+
+      primary.releaseMemObjects();
+      shadow.releaseMemObjects();
+    }
+  }
+  catch (std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+  }
+}
@@ -14,6 +14,15 @@ int main() {
     square.bindOutput(1);
     square.evaluate();
     square.showBuffer(1);
+
+    // The same kernel with its signature checked by the compiler
+    auto typedSquare = framework.load<Input, Output>("squarefloat");
+    typedSquare.bind(std::vector<float> { 1.1, 2.2, 3.3 }, Output());
+    typedSquare.evaluate();
+    for (float value : typedSquare.getBuffer<1>()) {
+      std::cout << value << " ";
+    }
+    std::cout << std::endl;
   }
   catch (std::exception& e) {
     std::cerr << "Error: " << e.what() << std::endl;
@@ -5,7 +5,9 @@
 
 #include "opencl-crossplatform.h"
 
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 class BoundValue : public ErrorHandler {
 
@@ -43,6 +45,10 @@ public:
     T * scalarT = (T*) scalar;
     return *scalarT;
   }
+
+  // The bytes passed to clSetKernelArg
+  const char * getData() { return scalar; }
+  size_t getSize() { return size; }
 private:
   size_t size = 0;
   char * scalar;
@@ -52,25 +58,89 @@ private:
 /*******************************************************/
 //  Buffers
 /*******************************************************/
+
+// How the elements of a buffer are stored on the device
+// Half and BFloat16 hold 16 bit floats for kernels which compute in float
+enum class Storage {
+  Native,     // the type of the kernel
+  Half,       // IEEE 754 half precision, read with vload_half / vstore_half
+  BFloat16    // the upper 16 bits of a float
+};
+
 class BoundBuffer : public BoundValue {
 public:
   //Main constructor
-  BoundBuffer(cl_mem, uint);
+  BoundBuffer(cl_mem, uint, size_t, Storage = Storage::Native);
 
   //Move constructor & destructor
   BoundBuffer(BoundBuffer&&);
   ~BoundBuffer();
 
   uint getSize();
+  size_t getBytes() { return size * elementSize; }
+  Storage getStorage() { return storage; }
   operator cl_mem();
 
   cl_mem& getMemObject() {
     return buffer;
   }
 
+  // Point the binding at a different memory object, eg. after a compaction
+  void reset(cl_mem, uint);
+
+  // Sub-buffers: a view of 'size' elements starting at 'offset' in 'parent'
+  void setView(cl_mem, uint);
+  bool isView() { return parent != NULL; }
+  cl_mem getParent() { return parent; }
+  uint getOffset() { return offset; }
+  size_t getElementSize() { return elementSize; }
+
+  // Outputs are written by their kernel before being read, their memory
+  // can be shared with buffers which are not alive at the same time
+  void markOutput() { output = true; }
+  bool isOutput() { return output; }
+
+  // Arrays of cl_int bound with bindArray, whatever the type of the kernel,
+  // eg. the keys of a histogram
+  void markInt() { intElements = true; }
+  bool holdsInt() { return intElements; }
+
+  // Arrays bound with bindArray whose elements are not of the type of the
+  // kernel, read with Kernel::getArray instead of getBuffer
+  void markOtherType() { otherType = true; }
+  bool holdsOtherType() { return otherType; }
+
+  // One field of an array of structs (bindStructs, bindStructOutput), read
+  // back as structs with Kernel::getStructs
+  void markField() { field = true; }
+  bool isField() { return field; }
+
+  // Spilled buffers hold their contents on the host instead of the device,
+  // see EasyOpenCL::setMemoryBudget
+  bool isSpilled() { return spilled; }
+  std::vector<char>& getHostCopy() { return hostCopy; }
+  void setSpilled(bool);
+
+  // Recency for choosing which buffer to spill
+  void touch(uint64_t time) { lastUse = time; }
+  uint64_t getLastUse() { return lastUse; }
+
 private:
   uint size = 0;
+  size_t elementSize = 0;
+  Storage storage = Storage::Native;
   cl_mem buffer;
+
+  cl_mem parent = NULL;
+  uint offset = 0;
+  bool output = false;
+  bool intElements = false;
+  bool otherType = false;
+  bool field = false;
+
+  bool spilled = false;
+  std::vector<char> hostCopy;
+  uint64_t lastUse = 0;
 };
 
 /*******************************************************/
@@ -91,12 +161,19 @@ public:
 
   uint getSize();
 
+  Kernel<T>* getSourceKernel() { return sourceKernel; }
+  uint getSourceArgPos() { return sourceArgPos; }
+  BoundBuffer* getView() { return view.get(); }
+
 private:
 
   Kernel<T> * sourceKernel;
   uint sourceArgPos;
   uint targetArgPos;
   uint size;
+
+  // Set when only a slice of the source buffer is bound
+  std::unique_ptr<BoundBuffer> view;
 };
 
 #endif
@@ -0,0 +1,73 @@
+#ifndef _DEVICESELECTOR_
+#define _DEVICESELECTOR_
+
+#include "errorhandler.h"
+
+#include "opencl-crossplatform.h"
+
+#include <string>
+#include <vector>
+
+/*******************************************************/
+//  Choosing the device a framework runs on
+//
+//  Without any criteria the first GPU is taken, falling
+//  back to the first CPU. Names match on a case insensitive
+//  substring. Matching devices are ranked GPU, accelerator,
+//  CPU, then by platform and device order.
+//
+//  The EASYOPENCL_DEVICE environment variable overrides the
+//  criteria set in code, eg.
+//    EASYOPENCL_DEVICE="platform=intel,type=cpu,partition=numa,sub=1"
+//  Keys: platform, device, type (gpu|cpu|accelerator|all),
+//  units, memory (bytes, K/M/G suffix), index,
+//  partition (equally:N | counts:N+N+... | numa | l1..l4 | next), sub
+//
+//  A partitioned device is split with clCreateSubDevices
+//  (OpenCL 1.2) and only sub-device 'sub' is used, so
+//  separate frameworks can be pinned to separate cores.
+/*******************************************************/
+class DeviceSelector : public ErrorHandler {
+public:
+  DeviceSelector& platform(std::string name) { platformName = name; return *this; }
+  DeviceSelector& device(std::string name) { deviceName = name; return *this; }
+  DeviceSelector& type(cl_device_type type_) { deviceType = type_; return *this; }
+  DeviceSelector& minComputeUnits(cl_uint units) { computeUnits = units; return *this; }
+  DeviceSelector& minMemory(cl_ulong bytes) { memory = bytes; return *this; }
+
+  // The n-th device of the ranking
+  DeviceSelector& index(uint n) { deviceIndex = n; return *this; }
+
+  // Sub-devices of 'units' compute units each
+  DeviceSelector& partitionEqually(cl_uint units, uint sub = 0);
+  // Sub-devices with the given numbers of compute units
+  DeviceSelector& partitionByCounts(std::vector<cl_uint> counts, uint sub = 0);
+  // A sub-device per NUMA node or shared cache
+  DeviceSelector& partitionByAffinity(cl_device_affinity_domain = CL_DEVICE_AFFINITY_DOMAIN_NUMA, uint sub = 0);
+
+  // Apply a specification in the format of EASYOPENCL_DEVICE
+  DeviceSelector& parse(std::string);
+
+  // The selected device, a sub-device has to be released with clReleaseDevice
+  cl_device_id select(bool verbose = false);
+
+private:
+  bool matches(std::string, std::string);
+  cl_device_id partition(cl_device_id);
+
+  enum class Partition { None, Equally, ByCounts, ByAffinity };
+
+  std::string platformName;
+  std::string deviceName;
+  cl_device_type deviceType = 0;      // 0: GPU, falling back to CPU
+  cl_uint computeUnits = 0;
+  cl_ulong memory = 0;
+  uint deviceIndex = 0;
+
+  Partition partitionType = Partition::None;
+  std::vector<cl_uint> counts;
+  cl_device_affinity_domain affinityDomain = 0;
+  uint subDevice = 0;
+};
+
+#endif
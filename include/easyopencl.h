@@ -4,32 +4,107 @@
 
 #include "errorhandler.h"
 #include "boundvalue.h"
+#include "deviceselector.h"
+#include "kernelregistry.h"
 #include "kernel.h"
+#include "primitives.h"
+#include "memoryplanner.h"
+#include "graphanalysis.h"
+#include "telemetry.h"
+#include "sharedmemory.h"
+#include "sparsematrix.h"
+#include "random.h"
 
 #include "opencl-crossplatform.h"
 
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+
+template<typename T, typename... Args> class TypedKernel;
 
 #define SHOW_DEBUG true
 #define NO_DEBUG false
 
 template<typename T>
 class EasyOpenCL : public ErrorHandler {
+
+	template <typename> friend class Kernel;
+	template <typename> friend class Primitives;
+	template <typename> friend class MemoryPlanner;
+	template <typename> friend class GraphAnalysis;
+	template <typename, typename...> friend class TypedKernel;
+	template <typename> friend class JobServer;
+
 public:
-	EasyOpenCL(bool);
+	EasyOpenCL(bool, DeviceSelector = DeviceSelector());
 
-	// Loading a kernel
+	// Loading a kernel, or another instance of a kernel under a new id
 	Kernel<T>& load(std::string);
+	Kernel<T>& load(std::string, std::string);
+
+	// Loading a kernel with its argument kinds declared, see typedkernel.h
+	template<typename... Args>
+	TypedKernel<T, Args...> load(std::string kernelName) { return TypedKernel<T, Args...>(*this, kernelName); }
+
+	// Uploading a sparse matrix, the kernel computes y = A * x (SpMV::X, SpMV::Y)
+	Kernel<T>& loadSpMV(std::string, const SparseMatrix<T>&, SparseFormat = SparseFormat::CSR);
+
+	// A source of random numbers, reproducible from the seed and the offset
+	// into the stream, the kernel writes 'length' values to Random::Output
+	Kernel<T>& loadRandom(std::string, uint, Distribution, cl_ulong seed, cl_ulong offset = 0, T a = 0, T b = 1);
 
 	// Linking the buffers
-	void link(Kernel<T>&, Kernel<T>&, std::map<uint,uint>);
-	void link(Kernel<T>&, Kernel<T>&, uint, std::map<uint,uint>);
+	void link(Kernel<T>&, Kernel<T>&, std::map<uint,uint>, Storage = Storage::Native);
+	void link(Kernel<T>&, Kernel<T>&, uint, std::map<uint,uint>, Storage = Storage::Native);
 
 	// Evaluating the results
 	void evaluate(std::string id);
 
+	// Run kernels repeatedly, the output buffer becomes the next input
+	void iterate(Kernel<T>&, uint, uint, uint);
+	void iterate(Kernel<T>&, uint, Kernel<T>&, uint, uint);
+
+	// ... until a device side flag stays set, returns the iterations run
+	uint iterateUntil(Kernel<T>&, uint, uint, uint, uint, uint = 1);
+	uint iterateUntil(Kernel<T>&, uint, Kernel<T>&, uint, uint, uint, uint = 1);
+
+	// Write the binary of a kernel for this device, for embedding
+	void writeBinary(std::string, std::string);
+
+	// Measure the device time of launches and transfers (before loading kernels)
+	void enableProfiling();
+
+	// Kernels loaded afterwards compile their scalars in as constants once they
+	// ran this often with the same values, see Kernel::setSpecialization
+	void enableSpecialization(uint hotLaunches = 1000) { specializeAfter = hotLaunches; }
+
+	// Critical path and .dot export of the graph evaluated by a kernel
+	GraphAnalysis<T> analyse(Kernel<T>&);
+
+	// Share the memory of intermediates which are not alive at the same time
+	MemoryPlan plan(Kernel<T>&);
+
+	// Data-parallel building blocks (scan, compaction, sorting)
+	Primitives<T>& primitives() { return builtins; }
+
+	// Host side counters and timers
+	const Telemetry& getTelemetry() { return telemetry; }
+	void resetTelemetry() { telemetry.reset(); }
+
+	// Host containers in shared virtual memory, see sharedmemory.h
+	template<typename U>
+	SVMAllocator<U> svmAllocator() { return SVMAllocator<U>(&svm); }
+	bool supportsSVM() { return svm.isSupported(); }
+
+	// Device memory of the buffers bound to kernels, in bytes. Above the
+	// budget (0 for none) the least recently used buffers move to the host.
+	void setMemoryBudget(size_t bytes) { memoryBudget = bytes; }
+	size_t getMemoryBudget() { return memoryBudget; }
+	size_t getDeviceMemory();
+	size_t getPeakDeviceMemory() { return peakDeviceMemory; }
+
 	// Cleaning up afterwards
 	void cleanup();
 
@@ -38,16 +113,41 @@ public:
 
 private:
 	void printDeviceProperty(cl_device_id);
+	cl_program getProgram(std::string, std::string, std::string = "");
+	std::string getSource(std::string);
+	cl_program getProgramFromSource(std::string, std::string, std::string);
+	cl_program buildProgram(std::string, std::string, std::string);
+	cl_program buildBinary(const EmbeddedKernel*);
+	void createCommandQueue();
+	cl_event* profilingEvent(cl_event& event) { return profiling ? &event : NULL; }
+	cl_ulong getDuration(cl_event);
+	std::vector<Kernel<T>*> prepareLoop(Kernel<T>&, uint, Kernel<T>&, uint);
+	void swapLoopBuffers(std::vector<Kernel<T>*>&, Kernel<T>&, uint, Kernel<T>&, uint);
+	void reserveMemory(Kernel<T>&, bool);
+	size_t countDeviceMemory(std::map<cl_mem, uint>&, std::set<cl_mem>&);
 
 
 	bool 							info;
+	bool							profiling = false;
+	uint							specializeAfter = 0;
 
 	cl_device_id* 		devices;
 	cl_context 				context;
 	cl_command_queue 	commandQueue;
 
 	std::map<std::string, Kernel<T>> kernels;
+	std::map<std::string, cl_program> programs;		// by options and source
+	Primitives<T>						builtins { this };
+	Telemetry									telemetry;
+	SharedMemory							svm;
+
+	size_t memoryBudget = 0;
+	size_t peakDeviceMemory = 0;
+	uint spilledBuffers = 0;
+	uint64_t memoryClock = 0;					// orders the launches for spilling
 	int vectorSize = -1;
 };
 
+#include "typedkernel.h"
+
 #endif
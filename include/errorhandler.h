@@ -3,14 +3,77 @@
 
 #include "opencl-crossplatform.h"
 
+#include <stdexcept>
 #include <string>
 
+// Failures of the framework itself (eg. missing arguments), reported by the
+// try* functions next to the status codes of OpenCL
+const cl_int EASYOPENCL_ERROR = -10000;
+
+/*******************************************************/
+//  Thrown when an OpenCL call fails
+/*******************************************************/
+class OpenCLError : public std::runtime_error {
+public:
+  OpenCLError(const std::string& message, cl_int code_) : std::runtime_error(message), errorCode(code_) {}
+
+  // The status returned by the call
+  cl_int code() const { return errorCode; }
+
+private:
+  cl_int errorCode;
+};
+
 class ErrorHandler {
 public:
   void raiseError(std::string errorString);
   void checkError(std::string errorLocation);
+
+  // On hot paths: only the call site and an argument are passed, the message
+  // is put together once the status turns out to be an error, eg.
+  // checkError("clSetKernelArg input", argPos)
+  void checkError(const char* site) {
+    if (status != CL_SUCCESS) failed(site);
+  }
+  void checkError(const char* site, long long argument) {
+    if (status != CL_SUCCESS) failed(site, argument);
+  }
+  void checkError(const char* site, const std::string& argument) {
+    if (status != CL_SUCCESS) failed(site, argument);
+  }
+
   std::string getErrorString(cl_int err);
   cl_int status;
+
+  // The message of the last failure caught by attempt() on this thread
+  static const std::string& getLastError();
+
+protected:
+  // Run f and return the status instead of throwing: CL_SUCCESS, the code of
+  // the failed OpenCL call or EASYOPENCL_ERROR. Nothing is formatted or
+  // allocated unless f fails.
+  template<typename F>
+  cl_int attempt(F&& f) noexcept {
+    try {
+      f();
+      return CL_SUCCESS;
+    }
+    catch (OpenCLError& e) {
+      setLastError(e.what());
+      return e.code();
+    }
+    catch (std::exception& e) {
+      setLastError(e.what());
+      return EASYOPENCL_ERROR;
+    }
+  }
+
+private:
+  // Out of line, the checks stay a comparison
+  [[noreturn]] void failed(const char*);
+  [[noreturn]] void failed(const char*, long long);
+  [[noreturn]] void failed(const char*, const std::string&);
+  static void setLastError(const char*) noexcept;
 };
 
 #endif
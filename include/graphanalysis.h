@@ -0,0 +1,63 @@
+#ifndef _GRAPHANALYSIS_
+#define _GRAPHANALYSIS_
+
+#include "errorhandler.h"
+
+#include "opencl-crossplatform.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+template <typename> class Kernel;
+
+/*******************************************************/
+//  Critical path of a kernel graph
+//
+//  The graph is the one evaluating the root runs. Every
+//  kernel weighs its last launch plus the transfers of that
+//  launch when the framework profiles (EasyOpenCL::enableProfiling()),
+//  and 1 otherwise, so the path then counts kernels.
+//  Analyse after evaluating to get measured weights.
+/*******************************************************/
+template<typename T>
+class GraphAnalysis : public ErrorHandler {
+public:
+  struct Node {
+    Kernel<T> * kernel;
+    cl_ulong executionTime = 0;   // ns
+    cl_ulong transferTime = 0;    // ns
+    cl_ulong weight = 0;
+
+    cl_ulong earliestStart = 0;
+    cl_ulong earliestFinish = 0;
+    cl_ulong latestStart = 0;
+    cl_ulong latestFinish = 0;
+    bool critical = false;
+
+    // How much later the kernel could finish without delaying the root
+    cl_ulong getSlack() const { return latestStart - earliestStart; }
+  };
+
+  GraphAnalysis(Kernel<T>&);
+
+  // In execution order, dependencies first
+  const std::vector<Node>& getNodes() const { return nodes; }
+  const std::vector<Kernel<T>*>& getCriticalPath() const { return criticalPath; }
+  cl_ulong getLength() const { return length; }
+  bool isProfiled() const { return profiled; }
+
+  // Graphviz: kernels as records with a port per argument, links as edges
+  // from the source argument to the target argument, the critical path in red
+  std::string toDot();
+  void writeDot(std::string);
+
+private:
+  std::vector<Node> nodes;
+  std::map<Kernel<T>*, size_t> index;
+  std::vector<Kernel<T>*> criticalPath;
+  cl_ulong length = 0;
+  bool profiled = false;
+};
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _HALFCONVERSION_
+#define _HALFCONVERSION_
+
+#include <cstddef>
+#include <cstdint>
+
+/*******************************************************/
+//  Conversion between float and the 16 bit storage formats
+//
+//  Both directions round to nearest even. The float to half
+//  conversion uses the F16C instructions when the CPU has them.
+/*******************************************************/
+void floatToHalf(const float*, uint16_t*, size_t);
+void halfToFloat(const uint16_t*, float*, size_t);
+
+void floatToBFloat16(const float*, uint16_t*, size_t);
+void bfloat16ToFloat(const uint16_t*, float*, size_t);
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef _JOBSERVER_
+#define _JOBSERVER_
+
+#include "errorhandler.h"
+
+#include "opencl-crossplatform.h"
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+template <typename> class EasyOpenCL;
+
+/*******************************************************/
+//  Job server (POSIX)
+//
+//  One long-running process owns the context, the compiled
+//  programs and a pool of device buffers, short-lived client
+//  processes submit jobs over a Unix domain socket.
+//
+//  A job is a pipeline of elementwise kernels which take
+//  (__global T* input, __global T* output), eg.
+//  {"squarefloat", "squarefloat"}, run over a payload in POSIX
+//  shared memory. The result is written back into the same
+//  shared memory, only the request and the reply go over
+//  the socket.
+//
+//  Jobs for the same pipeline arriving within the batch
+//  window are concatenated and run with one launch per
+//  kernel, so many small jobs keep the device busy.
+//
+//  Clients are read without blocking, a client which stops
+//  in the middle of a request does not hold up the others.
+/*******************************************************/
+template<typename T>
+class JobServer : public ErrorHandler {
+public:
+  JobServer(EasyOpenCL<T>&, std::string socketPath);
+  ~JobServer();
+
+  // Wait this long after a job arrives for others to batch with it
+  void setBatchWindow(std::chrono::milliseconds window) { batchWindow = window; }
+
+  // Batches stop growing at this many elements (larger jobs run alone)
+  void setMaxBatchSize(size_t elements) { maxBatchSize = elements; }
+
+  // Serve until stop() is called, eg. from a signal handler
+  void serve();
+  void stop() { stopping = true; }
+
+  uint getJobCount() { return jobCount; }
+  uint getBatchCount() { return batchCount; }
+
+private:
+  struct Job {
+    int client;
+    std::vector<std::string> pipeline;
+    std::string key;              // the pipeline, to batch on
+    T * payload = NULL;           // the mapped shared memory
+    size_t count = 0;
+  };
+
+  enum class Request { Incomplete, Malformed, Complete };
+
+  JobServer(const JobServer&) = delete;
+
+  bool receive(int);
+  Request readRequest(int, const std::string&, size_t&);
+  void runBatches();
+  void runBatch(std::vector<Job>&);
+  void respond(int, bool, std::string);
+  void unmap(Job&);
+  void disconnect(int);
+
+  cl_kernel getKernel(std::string);
+  cl_mem acquireBuffer(size_t&);
+
+  EasyOpenCL<T> * framework;
+  std::string socketPath;
+  int listener = -1;
+  std::vector<int> clients;
+  std::map<int, std::string> partial;           // the bytes of unfinished requests
+
+  std::vector<Job> pending;
+  std::chrono::steady_clock::time_point firstPending;
+  std::chrono::milliseconds batchWindow { 1 };
+  size_t maxBatchSize = 1 << 24;
+  volatile bool stopping = false;
+
+  std::map<std::string, cl_kernel> kernels;     // by name, built once
+  std::multimap<size_t, cl_mem> bufferPool;     // free buffers by capacity in bytes
+
+  uint jobCount = 0;
+  uint batchCount = 0;
+};
+
+/*******************************************************/
+//  Client of a JobServer with the same element type
+/*******************************************************/
+template<typename T>
+class JobClient : public ErrorHandler {
+public:
+  JobClient(std::string socketPath);
+  ~JobClient();
+
+  // Run the kernels one after the other over the input, on the server
+  std::vector<T> run(const std::vector<std::string>& pipeline, const std::vector<T>& input);
+
+private:
+  JobClient(const JobClient&) = delete;
+
+  int connection = -1;
+};
+
+#endif
@@ -4,19 +4,29 @@
 #include "easyopencl.h"
 #include "errorhandler.h"
 #include "boundvalue.h"
-
+#include "telemetry.h"
+#include "sharedmemory.h"
 
 #include "opencl-crossplatform.h"
 
+#include <array>
 #include <map>
+#include <set>
+#include <type_traits>
 #include <vector>
 
 template <typename> class EasyOpenCL;
+template <typename> class Primitives;
+template <typename> class MemoryPlanner;
+template <typename> class GraphAnalysis;
 
 template<typename T>
 class Kernel : public ErrorHandler {
 
   template <typename> friend class EasyOpenCL;
+  template <typename> friend class Primitives;
+  template <typename> friend class MemoryPlanner;
+  template <typename> friend class GraphAnalysis;
 
 public:
 
@@ -25,27 +35,94 @@ public:
   //  BINDING VALUES TO THE BUFFERS
   /*******************************************************/
   void bindInput(uint, std::vector<T>);
+  void bindInput(uint, std::vector<T>, Storage, bool convertOnDevice = false);
 
   void bindOutput(uint);
-  void bindOutput(uint, uint);
+  void bindOutput(uint, Storage);
+  void bindOutput(uint, uint, Storage = Storage::Native);
 
   template<typename S>
   void bindScalar(uint argPos, S value) {
     //Inline definition to avoid recompilation of the entire library
     //if you just want to add a new scalar type.
     status = clSetKernelArg(kernel, argPos, sizeof(S), &value);
-    checkError("clSetKernelArg singleValue " + std::to_string(argPos));
+    checkError("clSetKernelArg singleValue", argPos);
+    framework->telemetry.count(Telemetry::ArgumentSets);
+    compareScalar(argPos, &value, sizeof(S));
     erase(argPos);
     boundScalars.emplace(argPos, BoundScalar(value));
   }
 
   void bindPromise(Kernel<T>&, uint, uint);
+  void bindSlice(uint, Kernel<T>&, uint, uint, uint);
+
+  // Arrays of other element types (indices, offsets), they do not set the range
+  template<typename U>
+  void bindArray(uint argPos, const std::vector<U>& values) {
+    static_assert(std::is_trivial<U>::value, "The array elements have to be trivially copyable");
+    bindArray(argPos, values.empty() ? NULL : &values[0], values.size(), sizeof(U), std::is_same<U, cl_int>::value
+      , !std::is_same<U, T>::value);
+  }
+
+  // Arrays of structs as a structure of arrays: every field gets its own
+  // argument from argPos on, in the order given, eg.
+  //   bindStructs(0, particles, &Particle::position, &Particle::mass)
+  // for a kernel taking (__global float4* position, __global float* mass, ...).
+  // The structs are uploaded as they are and transposed on the device.
+  template<typename S, typename... F>
+  void bindStructs(uint argPos, const std::vector<S>& values, F S::*... fields) {
+    static_assert(std::is_trivial<S>::value, "The structs have to be trivially copyable");
+    static_assert(sizeof...(F) > 0, "Bind at least one field");
+    bindStructs(argPos, values.empty() ? NULL : &values[0], values.size(), sizeof(S)
+      , { StructField { fieldOffset(fields), sizeof(F) }... });
+  }
+
+  // Outputs with the layout of bindStructs, for 'count' structs
+  template<typename S, typename... F>
+  void bindStructOutput(uint argPos, uint count, F S::*... fields) {
+    static_assert(std::is_trivial<S>::value, "The structs have to be trivially copyable");
+    bindStructOutput(argPos, count, { StructField { fieldOffset(fields), sizeof(F) }... });
+  }
+
+  // The field arrays from argPos on back as structs, merged on the device.
+  // Fields which are not listed are zero.
+  template<typename S, typename... F>
+  std::vector<S> getStructs(uint argPos, F S::*... fields) {
+    static_assert(std::is_trivial<S>::value, "The structs have to be trivially copyable");
+    std::vector<S> values(resolveBuffer(argPos).getSize());
+    getStructs(argPos, values.empty() ? NULL : &values[0], values.size(), sizeof(S)
+      , { StructField { fieldOffset(fields), sizeof(F) }... });
+    return values;
+  }
+
+  // Shared virtual memory, see sharedmemory.h
+  void bindSVM(uint, void*, uint count = 0);
+
+  template<typename U>
+  void bindSVM(uint argPos, std::vector<U, SVMAllocator<U>>& values) {
+    bindSVM(argPos, values.data(), values.size());
+  }
 
   /*******************************************************/
   //  RUNNING A KERNEL
   /*******************************************************/
   void evaluate();
 
+  // The NDRange instead of the length of the buffers, a local size of 0
+  // lets the OpenCL runtime choose
+  void setWorkSize(size_t global, size_t local = 0) {
+    globalWorkSize = {{ global, 1 }};
+    localWorkSize = {{ local, 1 }};
+    workDimensions = 1;
+  }
+
+  // A 2D NDRange, eg. setWorkSize({{ width, height }}) for a work item per pixel
+  void setWorkSize(std::array<size_t, 2> global, std::array<size_t, 2> local = {{ 0, 0 }}) {
+    globalWorkSize = global;
+    localWorkSize = local;
+    workDimensions = 2;
+  }
+
 
   /*******************************************************/
   //  RETRIEVING VALUES FROM THE BUFFERS
@@ -54,6 +131,46 @@ public:
   void showBuffer(uint);
   void showBuffers();
 
+  // Arrays of other element types, eg. getArray<cl_uint>(argPos) after bindArray
+  template<typename U>
+  std::vector<U> getArray(uint argPos) {
+    static_assert(std::is_trivial<U>::value, "The array elements have to be trivially copyable");
+    std::vector<U> values(resolveBuffer(argPos).getSize());
+    getArray(argPos, values.empty() ? NULL : &values[0], values.size(), sizeof(U));
+    return values;
+  }
+
+  // After this many launches with the same scalar values (bindScalar) the
+  // kernel is rebuilt with the values as constants, so the compiler can fold
+  // them. Variants are kept per value, a changed scalar switches back to the
+  // generic kernel until the new values are stable (0 turns it off).
+  void setSpecialization(uint hotLaunches) { specializeAfter = hotLaunches; }
+  bool isSpecialized() { return kernel != genericKernel; }
+
+  /*******************************************************/
+  //  WITHOUT EXCEPTIONS
+  /*******************************************************/
+  // For latency critical loops: CL_SUCCESS, the status of the failed OpenCL
+  // call or EASYOPENCL_ERROR, the message is in ErrorHandler::getLastError()
+  cl_int tryBindInput(uint argPos, std::vector<T> input) { return attempt([&] { bindInput(argPos, std::move(input)); }); }
+  cl_int tryBindOutput(uint argPos) { return attempt([&] { bindOutput(argPos); }); }
+
+  template<typename S>
+  cl_int tryBindScalar(uint argPos, S value) { return attempt([&] { bindScalar(argPos, value); }); }
+
+  cl_int tryEvaluate() { return attempt([&] { evaluate(); }); }
+  cl_int tryGetBuffer(uint argPos, std::vector<T>& values) { return attempt([&] { values = getBuffer(argPos); }); }
+
+  /*******************************************************/
+  //  MEMORY PLANNING
+  /*******************************************************/
+  // The buffer at this position is read back, never share its memory
+  void keep(uint argPos) { keptBuffers.insert(argPos); }
+
+  // The kernel may write its outputs over an input it is the last user of
+  // (only safe when every work item reads its own elements before writing)
+  void setInPlace(bool allowed) { inPlace = allowed; }
+
   /*******************************************************/
   //  CLEANING UP
   /*******************************************************/
@@ -62,32 +179,109 @@ public:
   /*******************************************************/
   //  UTILITY
   /*******************************************************/
-  std::string getId() { return id; }
+  const std::string& getId() { return id; }
   uint getExecutionCount() { return executionCounter; }
 
+  // Device time in ns, only measured after EasyOpenCL::enableProfiling()
+  cl_ulong getExecutionTime();  // the last launch
+  cl_ulong getTransferTime() { return transferTime; }  // all uploads and reads
+  cl_ulong getLastTransferTime() { return lastTransferTime; }  // the uploads for the last launch and the reads since
+
+  // Device memory of the buffers owned by this kernel, spilled ones excluded
+  size_t getDeviceMemory();
+
 private:
 
   Kernel(std::string, cl_context&, cl_command_queue&
-        , cl_device_id*, std::string, EasyOpenCL<T>* );
+        , std::string, EasyOpenCL<T>*, std::string = "", std::string = "");
   operator cl_kernel();
 
   /*******************************************************/
   //  CONTROLLING THE BOUNDVALUE MAPS
   /*******************************************************/
   void erase(uint);
+  bool isSlice(uint);
+  void resolveOwner(uint, Kernel<T>*&, uint&);
+  BoundBuffer& resolveBuffer(uint, bool restoreSpilled = true);
+  BoundBuffer& prepareBuffer(uint);
+  void spill(uint);
+  void restore(uint);
+  std::vector<T> getReducedBuffer(BoundBuffer&);
+  cl_mem uploadBuffer(const void*, size_t, uint);
+  void bindArray(uint, const void*, size_t, size_t, bool, bool);
+  void getArray(uint, void*, size_t, size_t);
+
+  // A member of a struct, in bytes
+  struct StructField {
+    size_t offset;
+    size_t size;
+  };
+
+  template<typename S, typename F>
+  static size_t fieldOffset(F S::* field) {
+    S probe;
+    return (const char*)&(probe.*field) - (const char*)&probe;
+  }
+
+  void bindStructs(uint, const void*, size_t, size_t, std::vector<StructField>);
+  void bindStructOutput(uint, uint, std::vector<StructField>);
+  void getStructs(uint, void*, size_t, size_t, std::vector<StructField>);
+  void recordTransfer(cl_event, bool upload = false);
+  void collectExecutionOrder(std::vector<Kernel<T>*>&, std::set<Kernel<T>*>&);
+
+  void checkArguments();
+  void setBufferArgument(uint);
+  void launch();
+  void useSharedMemory();
+
+  /*******************************************************/
+  //  SPECIALIZATION
+  /*******************************************************/
+  void compareScalar(uint, const void*, size_t);
+  void specialize();
+  std::string scalarKey();
+  cl_kernel buildVariant();
+  void switchKernel(cl_kernel);
+  void releaseVariants();
   std::map<uint, BoundScalar> boundScalars;
   std::map<uint, BoundBuffer> boundBuffers;
   std::map<uint, BoundPromise<T>> boundPromises;
+  std::map<uint, void*> boundSVM;
+  uint svmGeneration = -1;
 
   std::string id;
   size_t vectorSize = -1;
+  std::map<uint, uint> outputLengths;   // outputs not sized by the inputs
+  std::array<size_t, 2> globalWorkSize {{ 0, 1 }};
+  std::array<size_t, 2> localWorkSize {{ 0, 1 }};
+  cl_uint workDimensions = 1;
 
   cl_kernel kernel;
+  cl_uint numArgs = 0;
+
+  // Where the kernel came from, for building specialized variants
+  std::string sourceFile;
+  std::string entryName;
+  std::string buildOptions;
+
+  cl_kernel genericKernel = NULL;
+  std::map<std::string, cl_kernel> variants;   // by the bytes of the scalars
+  uint specializeAfter = 0;
+  uint stableLaunches = 0;
+  uint scalarVersion = 0;     // counts changes of the scalar values
+  uint seenVersion = 0;
   cl_context context;
   cl_command_queue commandQueue;
 
+  std::set<uint> keptBuffers;
+  bool inPlace = false;
+
   uint executionCounter = 0;
-  const bool debug = false;
+  cl_event launchEvent = NULL;
+  cl_ulong transferTime = 0;
+  cl_ulong uploadTime = 0;          // since the last launch
+  cl_ulong lastTransferTime = 0;
+  bool debug = false;
   EasyOpenCL<T> * framework;
 };
 
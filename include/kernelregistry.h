@@ -0,0 +1,44 @@
+#ifndef _KERNELREGISTRY_
+#define _KERNELREGISTRY_
+
+#include <cstddef>
+#include <string>
+
+/*******************************************************/
+//  A kernel source, header or binary compiled into the
+//  program by cmake/modules/EmbedKernels.cmake
+/*******************************************************/
+struct EmbeddedKernel {
+  const char * name;              // the file name, eg. "squarefloat.cl"
+  const unsigned char * data;
+  size_t size;
+  bool binary;
+};
+
+/*******************************************************/
+//  Embedded files, looked up by their file name before
+//  the file system is tried
+/*******************************************************/
+class KernelRegistry {
+public:
+  static void add(const EmbeddedKernel*, size_t);
+
+  // The contents of an embedded source or header
+  static bool findSource(std::string, std::string&);
+
+  // The binary embedded for a kernel file, eg. squarefloat.bin for squarefloat.cl
+  static const EmbeddedKernel * findBinary(std::string);
+
+  // Replace #include "file" lines by embedded headers (once per header),
+  // other includes are left to the OpenCL compiler
+  static std::string inlineIncludes(std::string);
+};
+
+// Registers the files when the program starts
+struct KernelRegistration {
+  KernelRegistration(const EmbeddedKernel* kernels, size_t count) {
+    KernelRegistry::add(kernels, count);
+  }
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _MEMORYPLANNER_
+#define _MEMORYPLANNER_
+
+#include "errorhandler.h"
+
+#include "opencl-crossplatform.h"
+
+#include <cstddef>
+
+template <typename> class EasyOpenCL;
+template <typename> class Kernel;
+
+/*******************************************************/
+//  The outcome of planning the memory of a kernel graph
+/*******************************************************/
+struct MemoryPlan {
+  size_t peakBefore = 0;      // bytes of device memory held by the graph before planning
+  size_t peakAfter = 0;       // ... and after planning
+  uint intermediates = 0;     // buffers which only pass data between kernels
+  uint allocations = 0;       // memory objects backing those intermediates
+  uint inPlace = 0;           // intermediates written over a dead input
+};
+
+/*******************************************************/
+//  Static memory planner
+//
+//  Every link() gives the source kernel its own output buffer,
+//  alive for the lifetime of the graph. The planner walks the
+//  graph in execution order, computes when every intermediate
+//  is first written and last read, and lets intermediates
+//  with disjoint lifetimes share one memory object.
+//
+//  Intermediates are outputs which are consumed by a promise
+//  and not marked with Kernel::keep(). Plan before evaluating
+//  the graph and keep() every buffer read back afterwards.
+/*******************************************************/
+template<typename T>
+class MemoryPlanner : public ErrorHandler {
+public:
+  MemoryPlanner(EasyOpenCL<T>* framework_) : framework(framework_) {}
+
+  MemoryPlan plan(Kernel<T>&);
+
+private:
+  EasyOpenCL<T> * framework;
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef _PRIMITIVES_
+#define _PRIMITIVES_
+
+#include "errorhandler.h"
+#include "boundvalue.h"
+
+#include "opencl-crossplatform.h"
+
+#include <string>
+#include <map>
+#include <vector>
+
+template <typename> class EasyOpenCL;
+template <typename> class Kernel;
+
+// How groupBy() combines the values of a key
+enum class Aggregate { Sum, Count, Min, Max };
+
+/*******************************************************/
+//  Data-parallel building blocks
+//
+//  All primitives work in place on a buffer that is already
+//  bound to a kernel (as an input, an output or a promise).
+//  The result stays on the device, so kernels which depend
+//  on that buffer through link() pick it up directly.
+//
+//  The buffer is used as it is: evaluate the kernel which
+//  produces it before calling a primitive on it.
+/*******************************************************/
+template<typename T>
+class Primitives : public ErrorHandler {
+
+  template <typename> friend class EasyOpenCL;
+  template <typename> friend class Kernel;
+
+public:
+  // Prefix sums, the first element of an exclusive scan is 0
+  void exclusiveScan(Kernel<T>&, uint);
+  void inclusiveScan(Kernel<T>&, uint);
+
+  // Keep the elements for which the OpenCL C expression in 'predicate'
+  // holds, eg. "x > 0". The element is available as 'x'.
+  // Returns the number of elements left in the buffer. The kernel owning the
+  // buffer and the kernels reading it through a link launch over the new
+  // length, unless their range was set with setWorkSize.
+  uint compact(Kernel<T>&, uint, std::string predicate);
+
+  // Ascending LSD radix sort, 4 bits per pass
+  void radixSort(Kernel<T>&, uint);
+
+  // Keyed aggregation over the keys in [0, bins), others are skipped. The
+  // keys are int, bound with bindArray(keyPos, std::vector<int>) to a kernel
+  // of any type, or of the kernel's type and truncated to int.
+  // The (small) tables are returned to the host.
+  std::vector<uint> histogram(Kernel<T>&, uint keyPos, uint bins);
+  std::vector<T> groupBy(Kernel<T>&, uint keyPos, uint valuePos, uint bins, Aggregate);
+
+private:
+  Primitives(EasyOpenCL<T>* framework_) : framework(framework_) {}
+  Primitives(const Primitives&) = delete;
+
+  /*******************************************************/
+  //  HELPERS
+  /*******************************************************/
+  cl_kernel getKernel(std::string, std::string, std::string, std::string = "");
+  size_t getGroupSize(cl_kernel);
+  cl_mem createBuffer(size_t);
+  void setArg(cl_kernel, cl_uint, size_t, const void*);
+  void launch(cl_kernel, size_t, size_t, std::string);
+  void scan(cl_mem, uint, bool, bool);
+  BoundBuffer& ownerBuffer(Kernel<T>&, uint, Kernel<T>*&, uint&);
+  std::string keyOptions(BoundBuffer&);
+  bool fitsLocalMemory(size_t);
+  size_t getStridedSize(uint, size_t);
+  void readTable(cl_mem, void*, size_t);
+
+  // Narrow a float buffer into a 16 bit storage buffer on the device
+  void convert(cl_mem, cl_mem, uint, Storage);
+
+  // Copy a field of an array of structs into its own array and back, see
+  // Kernel::bindStructs
+  void splitField(cl_mem, cl_mem, uint, size_t, size_t, size_t);
+  void mergeField(cl_mem, cl_mem, uint, size_t, size_t, size_t);
+  void transposeField(std::string, cl_mem, cl_mem, uint, size_t, size_t, size_t);
+
+  void release();
+
+  // Built kernels, by file, entry point and build options
+  std::map<std::string, cl_kernel> kernels;
+
+  EasyOpenCL<T> * framework;
+};
+
+#endif
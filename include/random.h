@@ -0,0 +1,18 @@
+#ifndef _RANDOM_
+#define _RANDOM_
+
+#include "opencl-crossplatform.h"
+
+// The distribution of EasyOpenCL::loadRandom()
+enum class Distribution {
+  Uniform,    // in [a, b), integers in [a, b)
+  Normal      // mean a, standard deviation b, integers rounded
+};
+
+// The arguments of a loaded random kernel
+namespace Random {
+  const uint Output = 0;
+  const uint Offset = 4;    // a cl_ulong, rebind it to continue the stream
+}
+
+#endif
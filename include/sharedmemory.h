@@ -0,0 +1,81 @@
+#ifndef _SHAREDMEMORY_
+#define _SHAREDMEMORY_
+
+#include "errorhandler.h"
+
+#include "opencl-crossplatform.h"
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+/*******************************************************/
+//  Shared virtual memory (OpenCL 2.0)
+//
+//  Allocations which the host and the kernels address with
+//  the same pointers, so pointer-linked structures (trees,
+//  lists, graphs) can be built on the host and walked on the
+//  device without copies. On devices with fine-grained SVM
+//  both sides use the memory directly; coarse-grained
+//  allocations are mapped for the host except while a kernel
+//  using them runs.
+/*******************************************************/
+class SharedMemory : public ErrorHandler {
+public:
+  // Called by the framework once its context and queue exist
+  void init(cl_context*, cl_command_queue*, cl_device_id);
+
+  bool isSupported() { return capabilities != 0; }
+  bool isFineGrained();
+
+  void * allocate(size_t);
+  void free(void*);
+
+  // Around a launch: hand the allocations to the device and back
+  void release();
+  void acquire();
+
+  // Changes whenever an allocation is made or freed
+  uint getGeneration() { return generation; }
+  std::vector<void*> getPointers();
+
+  void cleanup();
+
+private:
+  cl_context * context = NULL;
+  cl_command_queue * commandQueue = NULL;
+  cl_bitfield capabilities = 0;
+
+  std::map<void*, size_t> allocations;
+  bool mapped = true;
+  uint generation = 0;
+};
+
+/*******************************************************/
+//  Allocator for host containers in shared memory
+//
+//    std::vector<Node, SVMAllocator<Node>> nodes(framework.svmAllocator<Node>());
+//    kernel.bindSVM(0, nodes);
+/*******************************************************/
+template<typename U>
+class SVMAllocator {
+public:
+  typedef U value_type;
+
+  SVMAllocator(SharedMemory * memory_) : memory(memory_) {}
+
+  template<typename V>
+  SVMAllocator(const SVMAllocator<V>& other) : memory(other.memory) {}
+
+  U * allocate(size_t n) { return static_cast<U*>(memory->allocate(n * sizeof(U))); }
+  void deallocate(U * pointer, size_t) { memory->free(pointer); }
+
+  template<typename V>
+  bool operator==(const SVMAllocator<V>& other) const { return memory == other.memory; }
+  template<typename V>
+  bool operator!=(const SVMAllocator<V>& other) const { return memory != other.memory; }
+
+  SharedMemory * memory;
+};
+
+#endif
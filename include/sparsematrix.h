@@ -0,0 +1,70 @@
+#ifndef _SPARSEMATRIX_
+#define _SPARSEMATRIX_
+
+#include "errorhandler.h"
+
+#include "opencl-crossplatform.h"
+
+#include <string>
+#include <vector>
+
+// How a sparse matrix is laid out on the device
+enum class SparseFormat {
+  CSR,        // compressed rows, a work item (scalar) or a group of lanes (vector) per row
+  ELL,        // every row padded to the longest row, column-major
+  SlicedELL   // ELL per slice of 32 rows, padded to the longest row of the slice
+};
+
+// The arguments of a loaded SpMV kernel, y = A * x
+namespace SpMV {
+  const uint X = 0;
+  const uint Y = 1;
+}
+
+/*******************************************************/
+//  A sparse matrix in CSR form on the host
+//
+//  rowPointers holds rows + 1 offsets into columnIndices
+//  and values. Load it with EasyOpenCL::loadSpMV(), which
+//  uploads the matrix and returns a kernel computing
+//  y = A * x that links into graphs like any other kernel.
+/*******************************************************/
+template<typename T>
+class SparseMatrix : public ErrorHandler {
+public:
+  SparseMatrix(uint rows_, uint columns_, std::vector<cl_uint> rowPointers_
+              , std::vector<cl_uint> columnIndices_, std::vector<T> values_);
+
+  // From (row, column, value) triplets in any order, duplicates are summed
+  static SparseMatrix<T> fromTriplets(uint, uint, const std::vector<cl_uint>&, const std::vector<cl_uint>&
+                                     , const std::vector<T>&);
+
+  uint getRows() const { return rows; }
+  uint getColumns() const { return columns; }
+  uint getNonZeros() const { return values.size(); }
+  double getAverageRowLength() const { return rows ? (double)values.size() / rows : 0.0; }
+  uint getMaxRowLength() const;
+
+  const std::vector<cl_uint>& getRowPointers() const { return rowPointers; }
+  const std::vector<cl_uint>& getColumnIndices() const { return columnIndices; }
+  const std::vector<T>& getValues() const { return values; }
+
+  // Padded column-major layouts, padding has column ELL_PADDING
+  static const cl_uint ELL_PADDING = 0xffffffff;
+  static const uint SLICE_HEIGHT = 32;
+
+  void toEll(std::vector<cl_uint>&, std::vector<T>&, uint&) const;
+  void toSlicedEll(std::vector<cl_uint>&, std::vector<cl_uint>&, std::vector<T>&) const;
+
+  // y = A * x on the host, for checking the device
+  std::vector<T> multiply(const std::vector<T>&);
+
+private:
+  uint rows;
+  uint columns;
+  std::vector<cl_uint> rowPointers;
+  std::vector<cl_uint> columnIndices;
+  std::vector<T> values;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef _SPECIALIZATION_
+#define _SPECIALIZATION_
+
+#include "opencl-crossplatform.h"
+
+#include <map>
+#include <string>
+
+/*******************************************************/
+//  Compiling scalar arguments into a kernel
+//
+//  The entry function keeps its signature, so the other
+//  arguments stay where they are, but the specialized
+//  parameters are no longer read: their values become
+//  __constant data the compiler can fold, eg.
+//
+//    __kernel void macfloat(..., const struct MAC mac)
+//
+//  turns into
+//
+//    __constant union { uchar bytes[8]; struct MAC value; }
+//      easyopencl_constant_2 = {{ 0x00, 0x00, 0x40, 0x40, ... }};
+//    __kernel void macfloat(..., const struct MAC easyopencl_unused_2)
+//    {
+//      const struct MAC mac = easyopencl_constant_2.value;
+//      ...
+/*******************************************************/
+class Specialization {
+public:
+  // The values are the bytes passed to clSetKernelArg, by argument position.
+  // False when the signature of the entry function is not understood.
+  static bool rewrite(const std::string& source, const std::string& entry
+                     , const std::map<uint, std::string>& values, std::string& specialized);
+};
+
+#endif
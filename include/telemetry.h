@@ -0,0 +1,140 @@
+#ifndef _TELEMETRY_
+#define _TELEMETRY_
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+/*******************************************************/
+//  Logging
+//
+//  Messages above EASYOPENCL_LOG_LEVEL are removed at compile
+//  time, the remaining ones are printed when 'enabled' holds
+//  (the SHOW_DEBUG / NO_DEBUG flag of the framework).
+/*******************************************************/
+#define LOG_NONE  0
+#define LOG_ERROR 1
+#define LOG_INFO  2
+#define LOG_DEBUG 3
+
+#ifndef EASYOPENCL_LOG_LEVEL
+#define EASYOPENCL_LOG_LEVEL LOG_INFO
+#endif
+
+#define EASYOPENCL_LOG(level, enabled, message)                     \
+  do {                                                              \
+    if ((level) <= EASYOPENCL_LOG_LEVEL && (enabled)) {             \
+      ((level) == LOG_ERROR ? std::cerr : std::cout)                \
+        << message << std::endl;                                    \
+    }                                                               \
+  } while (0)
+
+/*******************************************************/
+//  Histogram of durations in nanoseconds
+//  Power of two buckets: bucket i holds [2^i, 2^(i+1)) ns
+/*******************************************************/
+class Histogram {
+public:
+  void record(uint64_t);
+  void reset();
+
+  uint64_t getCount() const { return count; }
+  uint64_t getTotal() const { return total; }
+  uint64_t getMin() const { return count ? min : 0; }
+  uint64_t getMax() const { return max; }
+  double getMean() const { return count ? (double)total / count : 0.0; }
+
+  // Upper bound of the bucket containing the given quantile (0.0 - 1.0)
+  uint64_t getPercentile(double) const;
+
+  static const int numBuckets = 64;
+  uint64_t getBucket(int i) const { return buckets[i]; }
+
+private:
+  uint64_t count = 0;
+  uint64_t total = 0;
+  uint64_t min = UINT64_MAX;
+  uint64_t max = 0;
+  uint64_t buckets[numBuckets] = {};
+};
+
+/*******************************************************/
+//  Counters and timers of the host side of the framework
+//
+//  Define EASYOPENCL_NO_TELEMETRY to compile all of the
+//  recording away. Define it the same way for the library
+//  and the application, the inline classes below differ.
+/*******************************************************/
+class Telemetry {
+public:
+  enum Counter {
+    Launches,             // clEnqueueNDRangeKernel calls
+    ArgumentSets,         // clSetKernelArg calls
+    BufferAllocations,    // clCreateBuffer calls
+    BytesToDevice,
+    BytesFromDevice,
+    ProgramBuilds,        // clBuildProgram calls, shared programs are built once
+    BuffersSpilled,       // moved to host memory to stay within the memory budget
+    BuffersRestored,      // moved back to the device when they were needed
+    Specializations,      // kernel variants built with their scalars as constants
+    NumCounters
+  };
+
+  enum Timer {
+    Evaluate,             // Kernel::evaluate, including its dependencies
+    GetBuffer,            // Kernel::getBuffer, including the read
+    NumTimers
+  };
+
+  void count(Counter c, uint64_t n = 1) {
+#ifndef EASYOPENCL_NO_TELEMETRY
+    counters[c] += n;
+#endif
+  }
+
+  void record(Timer t, uint64_t ns) {
+#ifndef EASYOPENCL_NO_TELEMETRY
+    timers[t].record(ns);
+#endif
+  }
+
+  uint64_t get(Counter c) const { return counters[c]; }
+  const Histogram& get(Timer t) const { return timers[t]; }
+
+  void reset();
+  std::string report() const;
+
+  static const char * name(Counter);
+  static const char * name(Timer);
+
+private:
+  uint64_t counters[NumCounters] = {};
+  Histogram timers[NumTimers];
+};
+
+/*******************************************************/
+//  Records the lifetime of the scope into a timer
+/*******************************************************/
+class ScopedTimer {
+public:
+#ifndef EASYOPENCL_NO_TELEMETRY
+  ScopedTimer(Telemetry& telemetry_, Telemetry::Timer timer_)
+    : telemetry(telemetry_), timer(timer_), start(std::chrono::steady_clock::now()) {}
+
+  ~ScopedTimer() {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    telemetry.record(timer, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  }
+
+private:
+  Telemetry& telemetry;
+  Telemetry::Timer timer;
+  std::chrono::steady_clock::time_point start;
+#else
+  // Not even the clock is read
+  ScopedTimer(Telemetry&, Telemetry::Timer) {}
+#endif
+};
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef _TYPEDKERNEL_
+#define _TYPEDKERNEL_
+
+#include "easyopencl.h"
+#include "errorhandler.h"
+#include "telemetry.h"
+
+#include "opencl-crossplatform.h"
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*******************************************************/
+//  Argument kinds of a TypedKernel
+//
+//    auto square = framework.load<Input, Output>("squarefloat");
+//    square.bind(std::vector<float> {1, 2, 3}, Output());
+//    square.evaluate();
+//    square.getBuffer<1>();
+//
+//  Any other type is a scalar passed by value.
+/*******************************************************/
+
+// A buffer of T read by the kernel
+struct Input {};
+
+// A buffer of T written by the kernel, the length defaults to the range
+struct Output {
+  Output(uint size_ = 0) : size(size_) {}
+  uint size;
+};
+
+// A buffer of another TypedKernel, bound without copying
+struct DeviceBuffer {
+  cl_mem memObject;
+  uint size;
+};
+
+// What an Input is bound from
+template<typename T>
+struct InputValue {
+  InputValue(const std::vector<T>& values_) : values(&values_), buffer { NULL, (uint)values_.size() } {}
+  InputValue(DeviceBuffer buffer_) : values(NULL), buffer(buffer_) {}
+
+  const std::vector<T> * values;
+  DeviceBuffer buffer;
+};
+
+// The C++ type bound to an argument of kind Arg
+template<typename T, typename Arg>
+struct TypedArgument {
+  static_assert(std::is_trivial<Arg>::value, "A scalar argument has to be trivially copyable");
+  typedef Arg type;
+};
+
+template<typename T>
+struct TypedArgument<T, Input> {
+  typedef InputValue<T> type;
+};
+
+template<typename T>
+struct TypedArgument<T, Output> {
+  typedef Output type;
+};
+
+/*******************************************************/
+//  A kernel with its signature declared in C++
+//
+//  The arity and the types of the arguments are checked by
+//  the compiler, bind() sets all arguments at once and the
+//  buffers live in flat arrays indexed by position, so
+//  evaluate() is a single enqueue. Outputs and inputs
+//  uploaded from a vector keep their memory when they are
+//  rebound with the same length.
+//
+//  Release typed kernels before EasyOpenCL::cleanup().
+/*******************************************************/
+template<typename T, typename... Args>
+class TypedKernel : public ErrorHandler {
+public:
+  static const size_t arity = sizeof...(Args);
+
+  TypedKernel(EasyOpenCL<T>& framework_, std::string kernelName) : framework(&framework_), id(kernelName) {
+
+    kernel = clCreateKernel(framework->getProgram(kernelName + ".cl", ""), kernelName.c_str(), &status);
+    checkError("clCreateKernel", kernelName);
+
+    // The one query of the signature, the kernel source is only known at run time
+    cl_uint numArgs;
+    status = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint), &numArgs, NULL);
+    checkError("clGetKernelInfo CL_KERNEL_NUM_ARGS");
+
+    if (numArgs != arity) {
+      clReleaseKernel(kernel);
+      raiseError("'" + kernelName + "' takes " + std::to_string(numArgs) + " arguments, it was declared with "
+        + std::to_string(arity));
+    }
+
+    buffers.fill(NULL);
+    sizes.fill(0);
+    owned.fill(false);
+  }
+
+  TypedKernel(TypedKernel&& other) : framework(other.framework), id(other.id), kernel(other.kernel)
+                                   , buffers(other.buffers), sizes(other.sizes), owned(other.owned)
+                                   , range(other.range) {
+    other.kernel = NULL;
+    other.buffers.fill(NULL);
+  }
+
+  TypedKernel(const TypedKernel&) = delete;
+  TypedKernel& operator=(const TypedKernel&) = delete;
+
+  ~TypedKernel() {
+    // No errors from a destructor, the context may be gone already
+    for (cl_mem buffer : buffers) {
+      if (buffer != NULL) {
+        clReleaseMemObject(buffer);
+      }
+    }
+    if (kernel != NULL) {
+      clReleaseKernel(kernel);
+    }
+  }
+
+  /*******************************************************/
+  //  BINDING
+  /*******************************************************/
+  // One value per argument, of the type declared for it
+  void bind(const typename TypedArgument<T, Args>::type&... values) {
+    uint inputRange = rangeOf(values...);
+    if (inputRange) {
+      range = inputRange;
+    }
+    bindArguments<0>(values...);
+  }
+
+  // The number of work items, by default the length of the first input
+  void setRange(size_t range_) { range = range_; }
+
+  /*******************************************************/
+  //  RUNNING
+  /*******************************************************/
+  void evaluate() {
+    status = clEnqueueNDRangeKernel(framework->commandQueue, kernel, 1, NULL, &range, NULL, 0, NULL, NULL);
+    checkError("Running kernel", id);
+    framework->telemetry.count(Telemetry::Launches);
+  }
+
+  // Without exceptions, for latency critical loops: the status of the launch
+  cl_int tryEvaluate() {
+    cl_int result = clEnqueueNDRangeKernel(framework->commandQueue, kernel, 1, NULL, &range, NULL, 0, NULL, NULL);
+    if (result == CL_SUCCESS) {
+      framework->telemetry.count(Telemetry::Launches);
+    }
+    return result;
+  }
+
+  // ... and of binding, the message of a failure is in getLastError()
+  cl_int tryBind(const typename TypedArgument<T, Args>::type&... values) {
+    return attempt([&] { bind(values...); });
+  }
+
+  /*******************************************************/
+  //  RETRIEVING
+  /*******************************************************/
+  template<size_t Pos>
+  std::vector<T> getBuffer() {
+    assertBuffer<Pos>();
+
+    std::vector<T> values(sizes[Pos]);
+    if (values.empty()) {
+      return values;
+    }
+
+    status = clEnqueueReadBuffer(framework->commandQueue, buffers[Pos], CL_TRUE, 0, sizes[Pos] * sizeof(T)
+      , &values[0], 0, NULL, NULL);
+    checkError("clEnqueueReadBuffer", Pos);
+    framework->telemetry.count(Telemetry::BytesFromDevice, sizes[Pos] * sizeof(T));
+    return values;
+  }
+
+  // Bind the buffer as an Input of another typed kernel
+  template<size_t Pos>
+  DeviceBuffer buffer() {
+    assertBuffer<Pos>();
+    return DeviceBuffer { buffers[Pos], (uint)sizes[Pos] };
+  }
+
+  std::string getId() { return id; }
+
+private:
+  template<size_t Pos>
+  void assertBuffer() {
+    typedef typename std::tuple_element<Pos, std::tuple<Args...>>::type Arg;
+    static_assert(std::is_same<Arg, Input>::value || std::is_same<Arg, Output>::value
+      , "The argument at this position is not a buffer");
+  }
+
+  // The length of the first input bound from a vector or a buffer
+  uint rangeOf() { return 0; }
+
+  template<typename V, typename... Rest>
+  uint rangeOf(const V&, const Rest&... rest) { return rangeOf(rest...); }
+
+  template<typename... Rest>
+  uint rangeOf(const InputValue<T>& value, const Rest&... rest) {
+    return value.buffer.size ? value.buffer.size : rangeOf(rest...);
+  }
+
+  template<size_t Pos>
+  void bindArguments() {}
+
+  template<size_t Pos, typename V, typename... Rest>
+  void bindArguments(const V& value, const Rest&... rest) {
+    bindArgument(Pos, value);
+    bindArguments<Pos + 1>(rest...);
+  }
+
+  void bindArgument(uint argPos, const InputValue<T>& value) {
+
+    if (value.values != NULL) {
+      size_t size = value.values->size();
+
+      // Upload into the memory of the vector bound before if the length is the same
+      if (buffers[argPos] == NULL || !owned[argPos] || sizes[argPos] != size) {
+        replaceBuffer(argPos, createBuffer(argPos, size), size);
+        owned[argPos] = true;
+      }
+
+      // Blocking, the vector may be gone after bind() returns
+      if (size) {
+        status = clEnqueueWriteBuffer(framework->commandQueue, buffers[argPos], CL_TRUE, 0, size * sizeof(T)
+          , &(*value.values)[0], 0, NULL, NULL);
+        checkError("clEnqueueWriteBuffer input", argPos);
+        framework->telemetry.count(Telemetry::BytesToDevice, size * sizeof(T));
+      }
+    } else {
+      cl_mem buffer = value.buffer.memObject;
+      status = clRetainMemObject(buffer);
+      checkError("clRetainMemObject input", argPos);
+
+      replaceBuffer(argPos, buffer, value.buffer.size);
+      owned[argPos] = false;
+    }
+  }
+
+  void bindArgument(uint argPos, const Output& output) {
+
+    uint size = output.size ? output.size : range;
+    if (size == 0) {
+      raiseError("Unable to determine the length of output " + std::to_string(argPos) + " of '" + id + "'");
+    }
+
+    // Keep the memory of an output bound with the same length before
+    if (buffers[argPos] != NULL && sizes[argPos] == size) {
+      return;
+    }
+
+    replaceBuffer(argPos, createBuffer(argPos, size), size);
+  }
+
+  template<typename S>
+  void bindArgument(uint argPos, const S& value) {
+    status = clSetKernelArg(kernel, argPos, sizeof(S), &value);
+    checkError("clSetKernelArg scalar", argPos);
+    framework->telemetry.count(Telemetry::ArgumentSets);
+  }
+
+  cl_mem createBuffer(uint argPos, size_t size) {
+    // OpenCL does not allow empty buffers
+    cl_mem buffer = clCreateBuffer(framework->context, CL_MEM_READ_WRITE, std::max(size, (size_t)1) * sizeof(T)
+      , NULL, &status);
+    checkError("clCreateBuffer", argPos);
+    framework->telemetry.count(Telemetry::BufferAllocations);
+    return buffer;
+  }
+
+  void replaceBuffer(uint argPos, cl_mem buffer, size_t size) {
+
+    if (buffers[argPos] != NULL) {
+      status = clReleaseMemObject(buffers[argPos]);
+      checkError("clReleaseMemObject", argPos);
+    }
+    buffers[argPos] = buffer;
+    sizes[argPos] = size;
+
+    status = clSetKernelArg(kernel, argPos, sizeof(cl_mem), &buffers[argPos]);
+    checkError("clSetKernelArg buffer", argPos);
+    framework->telemetry.count(Telemetry::ArgumentSets);
+  }
+
+  EasyOpenCL<T> * framework;
+  std::string id;
+  cl_kernel kernel = NULL;
+
+  // Indexed by argument position, scalars leave their slot empty
+  std::array<cl_mem, sizeof...(Args)> buffers;
+  std::array<size_t, sizeof...(Args)> sizes;
+  std::array<bool, sizeof...(Args)> owned;    // created here, not another kernel's buffer
+  size_t range = 0;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef _TYPETRAITS_
+#define _TYPETRAITS_
+
+#include <string>
+
+/*******************************************************/
+//  Mapping of the host types onto their OpenCL C names
+/*******************************************************/
+template<typename T>
+struct TypeTraits;
+
+template<>
+struct TypeTraits<int> {
+  static std::string name() { return "int"; }
+
+  // Build options used by the generic (-D T=...) built-in kernels
+  static std::string buildOptions() { return "-D T=int"; }
+};
+
+template<>
+struct TypeTraits<float> {
+  static std::string name() { return "float"; }
+  static std::string buildOptions() { return "-D T=float"; }
+};
+
+template<>
+struct TypeTraits<double> {
+  static std::string name() { return "double"; }
+  static std::string buildOptions() { return "-D T=double -D ENABLE_FP64"; }
+};
+
+#endif
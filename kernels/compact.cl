@@ -0,0 +1,29 @@
+#ifdef ENABLE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+// PREDICATE(x) is defined by the framework in front of this file
+
+// Flag the elements to keep, the positions are scanned afterwards
+__kernel void compact_flags(__global const T* input, __global int* flags
+                           , __global int* positions, const uint length)
+{
+  uint i = get_global_id(0);
+  if (i < length) {
+    T x = input[i];
+    int keep = PREDICATE(x) ? 1 : 0;
+    flags[i] = keep;
+    positions[i] = keep;
+  }
+}
+
+// Move the flagged elements to their (inclusive scan - 1) position
+__kernel void compact_scatter(__global const T* input, __global const int* flags
+                             , __global const int* positions, __global T* output
+                             , const uint length)
+{
+  uint i = get_global_id(0);
+  if (i < length && flags[i]) {
+    output[positions[i] - 1] = input[i];
+  }
+}
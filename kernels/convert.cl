@@ -0,0 +1,19 @@
+#include "storage.clh"
+
+// Narrowing of float buffers into the 16 bit storage formats
+
+__kernel void float_to_half(__global const float* input, __global half* output, const uint length)
+{
+  uint i = get_global_id(0);
+  if (i < length) {
+    vstore_half_rte(input[i], i, output);
+  }
+}
+
+__kernel void float_to_bfloat16(__global const float* input, __global ushort* output, const uint length)
+{
+  uint i = get_global_id(0);
+  if (i < length) {
+    store_bfloat16(input[i], i, output);
+  }
+}
@@ -0,0 +1,136 @@
+#ifdef ENABLE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+#ifdef ENABLE_INT64_ATOMICS
+#pragma OPENCL EXTENSION cl_khr_int64_base_atomics : enable
+#endif
+
+// KEY is the type of the keys, int or T, defined by the framework. Keys
+// outside [0, numBins) are skipped before they are converted, so large
+// float keys cannot wrap into the table.
+inline int binOf(KEY key, uint numBins)
+{
+  return (key >= 0 && key < numBins) ? (int)key : -1;
+}
+
+// Histograms count in uint, whatever the type of the keys
+__kernel void histogram_clear(__global uint* table, const uint numBins)
+{
+  uint i = get_global_id(0);
+  if (i < numBins) {
+    table[i] = 0;
+  }
+}
+
+// Every work group counts a strided share of the keys in a private table in
+// local memory, then adds the bins it touched to the global table
+__kernel void histogram_local(__global const KEY* keys, __global uint* table
+                             , __local uint* partial, const uint length, const uint numBins)
+{
+  for (uint b = get_local_id(0); b < numBins; b += get_local_size(0)) {
+    partial[b] = 0;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint i = get_global_id(0); i < length; i += get_global_size(0)) {
+    int bin = binOf(keys[i], numBins);
+    if (bin >= 0) {
+      atomic_inc(&partial[bin]);
+    }
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint b = get_local_id(0); b < numBins; b += get_local_size(0)) {
+    if (partial[b]) {
+      atomic_add(&table[b], partial[b]);
+    }
+  }
+}
+
+// Too many bins for local memory: every key goes to the global table
+__kernel void histogram_global(__global const KEY* keys, __global uint* table
+                              , const uint length, const uint numBins)
+{
+  for (uint i = get_global_id(0); i < length; i += get_global_size(0)) {
+    int bin = binOf(keys[i], numBins);
+    if (bin >= 0) {
+      atomic_inc(&table[bin]);
+    }
+  }
+}
+
+// OP(a, b) and IDENTITY are defined by the framework in front of this file
+// for the group by kernels. Integer tables use the atomic function ATOMIC_OP,
+// the others compare and swap the bits of the value as U with CMPXCHG
+#ifdef OP
+
+#ifdef ATOMIC_OP
+inline void combineLocal(volatile __local T* p, T value) { ATOMIC_OP(p, value); }
+inline void combineGlobal(volatile __global T* p, T value) { ATOMIC_OP(p, value); }
+#else
+#define COMBINE(SPACE, NAME)                                                \
+inline void NAME(volatile SPACE T* p, T value)                             \
+{                                                                           \
+  T old = *p;                                                               \
+  while (1) {                                                               \
+    T next = OP(old, value);                                                \
+    if (next == old) {                                                      \
+      return;                                                               \
+    }                                                                       \
+    U seen = CMPXCHG((volatile SPACE U*)p, AS_U(old), AS_U(next));          \
+    if (seen == AS_U(old)) {                                                \
+      return;                                                               \
+    }                                                                       \
+    old = AS_T(seen);                                                       \
+  }                                                                         \
+}
+COMBINE(__local, combineLocal)
+COMBINE(__global, combineGlobal)
+#endif
+
+__kernel void groupby_fill(__global T* table, const uint numBins)
+{
+  uint i = get_global_id(0);
+  if (i < numBins) {
+    table[i] = IDENTITY;
+  }
+}
+
+// Like histogram_local, with the values of the keys combined by OP
+__kernel void groupby_local(__global const KEY* keys, __global const T* values
+                           , __global T* table, __local T* partial
+                           , const uint length, const uint numBins)
+{
+  for (uint b = get_local_id(0); b < numBins; b += get_local_size(0)) {
+    partial[b] = IDENTITY;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint i = get_global_id(0); i < length; i += get_global_size(0)) {
+    int bin = binOf(keys[i], numBins);
+    if (bin >= 0) {
+      combineLocal(&partial[bin], values[i]);
+    }
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint b = get_local_id(0); b < numBins; b += get_local_size(0)) {
+    T value = partial[b];
+    if (value != IDENTITY) {
+      combineGlobal(&table[b], value);
+    }
+  }
+}
+
+// Too many bins for local memory: every element goes to the global table
+__kernel void groupby_global(__global const KEY* keys, __global const T* values
+                            , __global T* table, const uint length, const uint numBins)
+{
+  for (uint i = get_global_id(0); i < length; i += get_global_size(0)) {
+    int bin = binOf(keys[i], numBins);
+    if (bin >= 0) {
+      combineGlobal(&table[bin], values[i]);
+    }
+  }
+}
+#endif
@@ -0,0 +1,6 @@
+__kernel void movefloat(__global const float4* position, __global const float4* velocity, __global float4* moved
+                       , const float dt)
+{
+  int i = get_global_id(0);
+  moved[i] = position[i] + dt * velocity[i];
+}
@@ -0,0 +1,147 @@
+#ifdef ENABLE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+// T, K (the unsigned key type), AS_K and KEY_BITS are set by the framework
+#define RADIX_BITS 4
+#define RADIX (1 << RADIX_BITS)
+
+// Map a value onto an unsigned key with the same ordering
+inline K sortKey(T value)
+{
+  K key = AS_K(value);
+#ifdef KEY_FLOAT
+  // Negative floats: flip all bits, positive floats: flip the sign bit
+  K mask = (key >> (KEY_BITS - 1)) ? ~(K)0 : ((K)1 << (KEY_BITS - 1));
+  return key ^ mask;
+#else
+  // Two's complement integers: flip the sign bit
+  return key ^ ((K)1 << (KEY_BITS - 1));
+#endif
+}
+
+inline uint digitOf(T value, uint shift)
+{
+  return (uint)((sortKey(value) >> shift) & (RADIX - 1));
+}
+
+// Count the digits in every work group, stored digit-major:
+// histogram[digit * numGroups + group]
+__kernel void radix_count(__global const T* input, __global int* histogram
+                         , __local int* counts, const uint length, const uint shift)
+{
+  uint lid = get_local_id(0);
+  uint gid = get_global_id(0);
+
+  for (uint d = lid; d < RADIX; d += get_local_size(0)) {
+    counts[d] = 0;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (gid < length) {
+    atomic_inc(&counts[digitOf(input[gid], shift)]);
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint d = lid; d < RADIX; d += get_local_size(0)) {
+    histogram[d * get_num_groups(0) + get_group_id(0)] = counts[d];
+  }
+}
+
+// Exclusive scan of one value per work item in local memory (Blelloch, like
+// scan_blocks), the local size is a power of two. The sum of all values is
+// returned in total.
+inline uint scanLocal(__local uint* tmp, uint value, uint* total)
+{
+  uint lid = get_local_id(0);
+  uint groupSize = get_local_size(0);
+  tmp[lid] = value;
+
+  // Up-sweep: build the partial sums in place
+  uint d = 1;
+  for (uint n = groupSize >> 1; n > 0; n >>= 1) {
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid < n) {
+      uint x = d * (2 * lid + 1) - 1;
+      uint y = d * (2 * lid + 2) - 1;
+      tmp[y] += tmp[x];
+    }
+    d <<= 1;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+  *total = tmp[groupSize - 1];
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (lid == 0) {
+    tmp[groupSize - 1] = 0;
+  }
+
+  // Down-sweep: distribute the partial sums
+  for (uint n = 1; n < groupSize; n <<= 1) {
+    d >>= 1;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid < n) {
+      uint x = d * (2 * lid + 1) - 1;
+      uint y = d * (2 * lid + 2) - 1;
+      uint t = tmp[x];
+      tmp[x] = tmp[y];
+      tmp[y] += t;
+    }
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  uint result = tmp[lid];
+  barrier(CLK_LOCAL_MEM_FENCE);   // tmp is reused by the next scan
+  return result;
+}
+
+// Stable scatter: the offset of the digit for this group plus the number of
+// equal digits before this element within the group. The group sorts its
+// digits stably with one split per bit, each a local scan, and the rank is
+// the position in the sorted group minus the first position of the digit.
+// Work groups are at most 65536 items, the position fits in the low 16 bits.
+__kernel void radix_scatter(__global const T* input, __global T* output
+                           , __global const int* offsets, __local uint* items, __local uint* sums
+                           , __local uint* starts, const uint length, const uint shift)
+{
+  uint lid = get_local_id(0);
+  uint gid = get_global_id(0);
+
+  // Past the end: the largest digit, it stays behind the real ones as the
+  // sort is stable and these items are last in the group
+  T value = 0;
+  uint digit = RADIX - 1;
+
+  if (gid < length) {
+    value = input[gid];
+    digit = digitOf(value, shift);
+  }
+
+  // (digit, position) pairs, the zeros of a bit keep their order in front of the ones
+  uint item = (digit << 16) | lid;
+  for (uint bit = 16; bit < 16 + RADIX_BITS; bit++) {
+    uint one = (item >> bit) & 1;
+    uint zeros;
+    uint zerosBefore = scanLocal(sums, 1 - one, &zeros);
+
+    items[one ? zeros + lid - zerosBefore : zerosBefore] = item;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    item = items[lid];
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  // The first position of every digit in the sorted group
+  uint sortedDigit = item >> 16;
+  if (lid == 0 || (items[lid - 1] >> 16) != sortedDigit) {
+    starts[sortedDigit] = lid;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // The rank goes back to the item's position before the sort
+  items[item & 0xFFFF] = lid - starts[sortedDigit];
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (gid < length) {
+    output[offsets[digit * get_num_groups(0) + get_group_id(0)] + items[lid]] = value;
+  }
+}
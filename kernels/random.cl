@@ -0,0 +1,103 @@
+#ifdef ENABLE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al., SC'11)
+//
+// Value i of a stream is a pure function of the seed and i, so the numbers do
+// not depend on the work-group size or on how the stream is split into
+// buffers. Every work item encrypts one counter block into four 32 bit words,
+// giving PER_BLOCK values: 4 for 32 bit types, 2 for double.
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+uint4 philox4x32(uint4 counter, uint2 key)
+{
+  for (int round = 0; round < 10; round++) {
+    uint hi0 = mul_hi(PHILOX_M0, counter.x);
+    uint lo0 = PHILOX_M0 * counter.x;
+    uint hi1 = mul_hi(PHILOX_M1, counter.z);
+    uint lo1 = PHILOX_M1 * counter.z;
+
+    counter = (uint4)(hi1 ^ counter.y ^ key.x, lo1, hi0 ^ counter.w ^ key.y, lo0);
+    key += (uint2)(PHILOX_W0, PHILOX_W1);
+  }
+  return counter;
+}
+
+#ifdef WORDS_PER_VALUE
+#define PER_BLOCK 2
+#else
+#define PER_BLOCK 4
+#endif
+
+// Uniform in [0, 1) from 24 bits, or 53 bits for double
+float uniform24(uint x) { return (x >> 8) * 0x1.0p-24f; }
+
+#ifdef ENABLE_FP64
+double uniform53(uint x, uint y) { return ((ulong)(x >> 5) * 67108864UL + (y >> 6)) * 0x1.0p-53; }
+#endif
+
+// Fill output with values [offset, offset + length) of the stream
+//   uniform: a + (b - a) * U[0, 1), integers in [a, b)
+//   normal:  mean a, standard deviation b (Box-Muller, integers rounded)
+__kernel void random_fill(__global T* output, const uint length, const uint seedLow, const uint seedHigh
+                         , const ulong offset, const T a, const T b)
+{
+  ulong block = offset / PER_BLOCK + get_global_id(0);
+  uint4 r = philox4x32((uint4)((uint)block, (uint)(block >> 32), 0, 0), (uint2)(seedLow, seedHigh));
+
+  T values[PER_BLOCK];
+
+#if defined(WORDS_PER_VALUE) && !defined(NORMAL)
+  values[0] = a + (b - a) * uniform53(r.x, r.y);
+  values[1] = a + (b - a) * uniform53(r.z, r.w);
+
+#elif defined(WORDS_PER_VALUE)
+  double radius = sqrt(-2.0 * log(1.0 - uniform53(r.x, r.y)));
+  double angle = 2.0 * M_PI * uniform53(r.z, r.w);
+  values[0] = a + b * radius * cos(angle);
+  values[1] = a + b * radius * sin(angle);
+
+#elif defined(INTEGER) && !defined(NORMAL)
+  // The high word of the product maps the 32 bits onto [0, b - a)
+  uint range = (uint)(b - a);
+  values[0] = a + (T)mul_hi(r.x, range);
+  values[1] = a + (T)mul_hi(r.y, range);
+  values[2] = a + (T)mul_hi(r.z, range);
+  values[3] = a + (T)mul_hi(r.w, range);
+
+#elif !defined(NORMAL)
+  values[0] = a + (b - a) * uniform24(r.x);
+  values[1] = a + (b - a) * uniform24(r.y);
+  values[2] = a + (b - a) * uniform24(r.z);
+  values[3] = a + (b - a) * uniform24(r.w);
+
+#else
+  // 1 - U lies in (0, 1], the logarithm stays finite
+  float radius0 = sqrt(-2.0f * log(1.0f - uniform24(r.x)));
+  float angle0 = 2.0f * M_PI_F * uniform24(r.y);
+  float radius1 = sqrt(-2.0f * log(1.0f - uniform24(r.z)));
+  float angle1 = 2.0f * M_PI_F * uniform24(r.w);
+
+  float normals[4] = { radius0 * cos(angle0), radius0 * sin(angle0), radius1 * cos(angle1), radius1 * sin(angle1) };
+  for (int k = 0; k < 4; k++) {
+#ifdef INTEGER
+    values[k] = convert_int_rte(a + b * normals[k]);
+#else
+    values[k] = a + b * normals[k];
+#endif
+  }
+#endif
+
+  // The first and the last block can stick out of the buffer
+  for (uint k = 0; k < PER_BLOCK; k++) {
+    ulong index = block * PER_BLOCK + k;
+    if (index >= offset && index - offset < length) {
+      output[index - offset] = values[k];
+    }
+  }
+}
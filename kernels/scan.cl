@@ -0,0 +1,76 @@
+#ifdef ENABLE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+// Work-efficient (Blelloch) scan of one block of 2 * get_local_size(0) elements
+// The total of every block is written to blockSums
+__kernel void scan_blocks(__global T* data, __global T* blockSums, __local T* tmp
+                         , const uint length, const int inclusive)
+{
+  uint lid = get_local_id(0);
+  uint groupSize = get_local_size(0);
+  uint blockSize = groupSize * 2;
+  uint offset = get_group_id(0) * blockSize;
+
+  uint ai = lid;
+  uint bi = lid + groupSize;
+
+  T a = (offset + ai < length) ? data[offset + ai] : (T)0;
+  T b = (offset + bi < length) ? data[offset + bi] : (T)0;
+  tmp[ai] = a;
+  tmp[bi] = b;
+
+  // Up-sweep: build the partial sums in place
+  uint d = 1;
+  for (uint n = groupSize; n > 0; n >>= 1) {
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid < n) {
+      uint x = d * (2 * lid + 1) - 1;
+      uint y = d * (2 * lid + 2) - 1;
+      tmp[y] += tmp[x];
+    }
+    d <<= 1;
+  }
+
+  if (lid == 0) {
+    blockSums[get_group_id(0)] = tmp[blockSize - 1];
+    tmp[blockSize - 1] = 0;
+  }
+
+  // Down-sweep: distribute the partial sums
+  for (uint n = 1; n < blockSize; n <<= 1) {
+    d >>= 1;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid < n) {
+      uint x = d * (2 * lid + 1) - 1;
+      uint y = d * (2 * lid + 2) - 1;
+      T t = tmp[x];
+      tmp[x] = tmp[y];
+      tmp[y] += t;
+    }
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (offset + ai < length) {
+    data[offset + ai] = inclusive ? tmp[ai] + a : tmp[ai];
+  }
+  if (offset + bi < length) {
+    data[offset + bi] = inclusive ? tmp[bi] + b : tmp[bi];
+  }
+}
+
+// Add the scanned block totals to the elements of every block
+__kernel void scan_add(__global T* data, __global const T* blockOffsets, const uint length)
+{
+  uint lid = get_local_id(0);
+  uint groupSize = get_local_size(0);
+  uint offset = get_group_id(0) * groupSize * 2;
+  T add = blockOffsets[get_group_id(0)];
+
+  if (offset + lid < length) {
+    data[offset + lid] += add;
+  }
+  if (offset + lid + groupSize < length) {
+    data[offset + lid + groupSize] += add;
+  }
+}
@@ -0,0 +1,105 @@
+#ifdef ENABLE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+// Sparse matrix times vector, y = A * x
+// The first two arguments of every kernel are x and y (SpMV::X and SpMV::Y)
+
+#define ELL_PADDING 0xffffffff
+
+// CSR, one work item per row: best for short rows
+__kernel void spmv_csr_scalar(__global const T* x, __global T* y
+                             , __global const uint* rowPointers, __global const uint* columns
+                             , __global const T* values, const uint rows)
+{
+  uint row = get_global_id(0);
+  if (row >= rows) {
+    return;
+  }
+
+  T sum = 0;
+  for (uint i = rowPointers[row]; i < rowPointers[row + 1]; i++) {
+    sum += values[i] * x[columns[i]];
+  }
+  y[row] = sum;
+}
+
+#ifdef LANES
+// CSR, LANES work items per row reading the row together: best for long rows
+// A work group of GROUP_SIZE work items handles GROUP_SIZE / LANES rows
+__kernel void spmv_csr_vector(__global const T* x, __global T* y
+                             , __global const uint* rowPointers, __global const uint* columns
+                             , __global const T* values, const uint rows)
+{
+  __local T partial[GROUP_SIZE];
+
+  uint lid = get_local_id(0);
+  uint lane = lid % LANES;
+  uint row = get_global_id(0) / LANES;
+
+  // Work items past the last row still take part in the barriers
+  T sum = 0;
+  if (row < rows) {
+    for (uint i = rowPointers[row] + lane; i < rowPointers[row + 1]; i += LANES) {
+      sum += values[i] * x[columns[i]];
+    }
+  }
+  partial[lid] = sum;
+
+  // Reduce the lanes of every row
+  for (uint n = LANES / 2; n > 0; n >>= 1) {
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lane < n) {
+      partial[lid] += partial[lid + n];
+    }
+  }
+
+  if (lane == 0 && row < rows) {
+    y[row] = partial[lid];
+  }
+}
+#endif
+
+// ELL, column-major: entry k of a row is at k * rows + row
+__kernel void spmv_ell(__global const T* x, __global T* y
+                      , __global const uint* columns, __global const T* values
+                      , const uint rows, const uint width)
+{
+  uint row = get_global_id(0);
+  if (row >= rows) {
+    return;
+  }
+
+  T sum = 0;
+  for (uint k = 0; k < width; k++) {
+    uint column = columns[k * rows + row];
+    if (column != ELL_PADDING) {
+      sum += values[k * rows + row] * x[column];
+    }
+  }
+  y[row] = sum;
+}
+
+// Sliced ELL, column-major per slice of SLICE_HEIGHT rows
+__kernel void spmv_sliced_ell(__global const T* x, __global T* y
+                             , __global const uint* sliceOffsets, __global const uint* columns
+                             , __global const T* values, const uint rows)
+{
+  uint row = get_global_id(0);
+  if (row >= rows) {
+    return;
+  }
+
+  uint slice = row / SLICE_HEIGHT;
+  uint start = sliceOffsets[slice] + row % SLICE_HEIGHT;
+  uint end = sliceOffsets[slice + 1];
+
+  T sum = 0;
+  for (uint i = start; i < end; i += SLICE_HEIGHT) {
+    uint column = columns[i];
+    if (column != ELL_PADDING) {
+      sum += values[i] * x[column];
+    }
+  }
+  y[row] = sum;
+}
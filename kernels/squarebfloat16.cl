@@ -0,0 +1,8 @@
+#include "storage.clh"
+
+__kernel void squarebfloat16(__global const ushort* input, __global ushort* output)
+{
+  int i = get_global_id(0);
+  float x = load_bfloat16(i, input);
+  store_bfloat16(x * x, i, output);
+}
@@ -0,0 +1,6 @@
+__kernel void squarehalf(__global const half* input, __global half* output)
+{
+  int i = get_global_id(0);
+  float x = vload_half(i, input);
+  vstore_half(x * x, i, output);
+}
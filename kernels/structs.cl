@@ -0,0 +1,24 @@
+// Transposing arrays of structs into one array per field and back
+//
+// WORD is uint when the struct size, the field offset and the field size are
+// multiples of 4 bytes, otherwise uchar. Sizes and offsets are in words. A
+// work item moves one word, neighbours write (or read) neighbouring words of
+// the field array.
+
+__kernel void split_field(__global const WORD* structs, __global WORD* field, const uint count
+                         , const uint stride, const uint offset, const uint words)
+{
+  uint i = get_global_id(0);
+  if (i < count * words) {
+    field[i] = structs[(i / words) * stride + offset + i % words];
+  }
+}
+
+__kernel void merge_field(__global const WORD* field, __global WORD* structs, const uint count
+                         , const uint stride, const uint offset, const uint words)
+{
+  uint i = get_global_id(0);
+  if (i < count * words) {
+    structs[(i / words) * stride + offset + i % words] = field[i];
+  }
+}
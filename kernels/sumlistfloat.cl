@@ -0,0 +1,18 @@
+// Nodes of a linked list in shared virtual memory, the host builds the
+// list with its own pointers (see the SVM part of example/main.cpp)
+typedef struct Node {
+  float value;
+  __global struct Node* next;
+} Node;
+
+__kernel void sumlistfloat(__global Node* nodes, __global float* output)
+{
+  int i = get_global_id(0);
+
+  // The sum of the list from node i to its end
+  float sum = 0.0f;
+  for (__global Node* node = &nodes[i]; node != 0; node = node->next) {
+    sum += node->value;
+  }
+  output[i] = sum;
+}
@@ -0,0 +1,39 @@
+#include "bvh.clh"
+
+// One camera ray per pixel of a 2D NDRange
+//   hits: the hit point and the Lambert term towards the light, w < 0 for a miss
+__kernel void traceprimary(__global const struct Node* nodes, __global const struct Triangle* triangles
+                          , __global float4* hits, const struct Scene scene)
+{
+  uint x = get_global_id(0);
+  uint y = get_global_id(1);
+  uint width = get_global_size(0);
+  uint height = get_global_size(1);
+
+  // Row 0 is the top of the image
+  float u = (x + 0.5f) / width;
+  float v = 1.0f - (y + 0.5f) / height;
+
+  float3 origin = vload3(0, scene.origin);
+  float3 target = vload3(0, scene.lowerLeft) + u * vload3(0, scene.horizontal) + v * vload3(0, scene.vertical);
+  float3 direction = normalize(target - origin);
+
+  float t = INFINITY;
+  int hit = traverse(origin, direction, &t, false, nodes, triangles);
+
+  if (hit < 0) {
+    hits[y * width + x] = (float4)(0.0f, 0.0f, 0.0f, -1.0f);
+    return;
+  }
+
+  __global const struct Triangle* triangle = &triangles[hit];
+  float3 v0 = vload3(0, triangle->v);
+  float3 normal = normalize(cross(vload3(1, triangle->v) - v0, vload3(2, triangle->v) - v0));
+  if (dot(normal, direction) > 0.0f) {
+    normal = -normal;
+  }
+
+  float3 point = origin + t * direction;
+  float lambert = fmax(dot(normal, normalize(vload3(0, scene.light) - point)), 0.0f);
+  hits[y * width + x] = (float4)(point, lambert);
+}
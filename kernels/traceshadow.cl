@@ -0,0 +1,34 @@
+#include "bvh.clh"
+
+#define BACKGROUND 0.2f
+#define AMBIENT 0.1f
+
+// Rays off the surface start this far from it
+#define SHADOW_OFFSET 1e-3f
+
+// A shadow ray from every lit hit of traceprimary towards the light
+//   image: the brightness of every pixel
+__kernel void traceshadow(__global const struct Node* nodes, __global const struct Triangle* triangles
+                         , __global const float4* hits, __global float* image, const struct Scene scene)
+{
+  uint pixel = get_global_id(1) * get_global_size(0) + get_global_id(0);
+  float4 hit = hits[pixel];
+
+  if (hit.w < 0.0f) {
+    image[pixel] = BACKGROUND;
+    return;
+  }
+  if (hit.w == 0.0f) {
+    image[pixel] = AMBIENT;
+    return;
+  }
+
+  float3 toLight = vload3(0, scene.light) - hit.xyz;
+  float distance = length(toLight);
+  float3 direction = toLight / distance;
+
+  float t = distance - 2.0f * SHADOW_OFFSET;
+  bool occluded = traverse(hit.xyz + SHADOW_OFFSET * direction, direction, &t, true, nodes, triangles) >= 0;
+
+  image[pixel] = AMBIENT + (1.0f - AMBIENT) * (occluded ? 0.0f : hit.w);
+}
@@ -38,14 +38,27 @@ BoundScalar::~BoundScalar() {
 /*******************************************************/
 //  Buffers
 /*******************************************************/
-BoundBuffer::BoundBuffer(cl_mem b, uint s) {
+BoundBuffer::BoundBuffer(cl_mem b, uint s, size_t e, Storage st) {
   size = s;
+  elementSize = e;
+  storage = st;
   buffer = b;
 }
 
 BoundBuffer::BoundBuffer(BoundBuffer&& bb) {
   size = bb.size;
+  elementSize = bb.elementSize;
+  storage = bb.storage;
   buffer = bb.buffer;
+  parent = bb.parent;
+  offset = bb.offset;
+  output = bb.output;
+  intElements = bb.intElements;
+  otherType = bb.otherType;
+  field = bb.field;
+  spilled = bb.spilled;
+  hostCopy = std::move(bb.hostCopy);
+  lastUse = bb.lastUse;
 }
 
 BoundBuffer::~BoundBuffer() {}
@@ -58,6 +71,24 @@ uint BoundBuffer::getSize() {
   return size;
 }
 
+void BoundBuffer::reset(cl_mem b, uint s) {
+  buffer = b;
+  size = s;
+}
+
+void BoundBuffer::setView(cl_mem p, uint o) {
+  parent = p;
+  offset = o;
+}
+
+void BoundBuffer::setSpilled(bool s) {
+  spilled = s;
+  if (!spilled) {
+    // Give the host memory back
+    std::vector<char>().swap(hostCopy);
+  }
+}
+
 /*******************************************************/
 //  Promises
 /*******************************************************/
@@ -73,6 +104,7 @@ BoundPromise<T>::BoundPromise(BoundPromise&& bp) {
   sourceKernel = bp.sourceKernel;
   sourceArgPos = bp.sourceArgPos;
   targetArgPos = bp.targetArgPos;
+  view = std::move(bp.view);
 }
 
 template<typename T>
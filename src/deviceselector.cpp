@@ -0,0 +1,289 @@
+#include "deviceselector.h"
+#include "telemetry.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+static std::string lowercase(std::string text) {
+  std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+  return text;
+}
+
+static std::string platformString(cl_platform_id platform, cl_platform_info param) {
+  size_t size = 0;
+  clGetPlatformInfo(platform, param, 0, NULL, &size);
+  std::string value(size, '\0');
+  clGetPlatformInfo(platform, param, size, &value[0], NULL);
+  return value.c_str();
+}
+
+static std::string deviceString(cl_device_id device, cl_device_info param) {
+  size_t size = 0;
+  clGetDeviceInfo(device, param, 0, NULL, &size);
+  std::string value(size, '\0');
+  clGetDeviceInfo(device, param, size, &value[0], NULL);
+  return value.c_str();
+}
+
+// Lower ranks are preferred
+static int typeRank(cl_device_type type) {
+  if (type & CL_DEVICE_TYPE_GPU)          { return 0; }
+  if (type & CL_DEVICE_TYPE_ACCELERATOR)  { return 1; }
+  if (type & CL_DEVICE_TYPE_CPU)          { return 2; }
+  return 3;
+}
+
+/******************************************************************************/
+//  PARTITIONING
+/******************************************************************************/
+DeviceSelector& DeviceSelector::partitionEqually(cl_uint units, uint sub) {
+  partitionType = Partition::Equally;
+  counts = { units };
+  subDevice = sub;
+  return *this;
+}
+
+DeviceSelector& DeviceSelector::partitionByCounts(std::vector<cl_uint> counts_, uint sub) {
+  partitionType = Partition::ByCounts;
+  counts = counts_;
+  subDevice = sub;
+  return *this;
+}
+
+DeviceSelector& DeviceSelector::partitionByAffinity(cl_device_affinity_domain domain, uint sub) {
+  partitionType = Partition::ByAffinity;
+  affinityDomain = domain;
+  subDevice = sub;
+  return *this;
+}
+
+/**
+ * Split a device into sub-devices and keep one of them
+ *
+ * Input:   cl_device_id device - the root device
+ *
+ * Output:  cl_device_id        - sub-device 'subDevice', the others are released
+ */
+cl_device_id DeviceSelector::partition(cl_device_id device) {
+
+#ifdef CL_VERSION_1_2
+  std::vector<cl_device_partition_property> properties;
+
+  switch (partitionType) {
+    case Partition::Equally:
+      properties = { CL_DEVICE_PARTITION_EQUALLY, (cl_device_partition_property)counts[0] };
+      break;
+    case Partition::ByCounts:
+      properties = { CL_DEVICE_PARTITION_BY_COUNTS };
+      for (cl_uint count : counts) {
+        properties.push_back(count);
+      }
+      properties.push_back(CL_DEVICE_PARTITION_BY_COUNTS_LIST_END);
+      break;
+    case Partition::ByAffinity:
+      properties = { CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, (cl_device_partition_property)affinityDomain };
+      break;
+    default:
+      return device;
+  }
+  properties.push_back(0);
+
+  cl_uint numSubDevices = 0;
+  status = clCreateSubDevices(device, &properties[0], 0, NULL, &numSubDevices);
+  checkError("clCreateSubDevices " + deviceString(device, CL_DEVICE_NAME));
+
+  if (subDevice >= numSubDevices) {
+    raiseError("Sub-device " + std::to_string(subDevice) + " requested, the partition has "
+      + std::to_string(numSubDevices));
+  }
+
+  std::vector<cl_device_id> subDevices(numSubDevices);
+  status = clCreateSubDevices(device, &properties[0], numSubDevices, &subDevices[0], NULL);
+  checkError("clCreateSubDevices " + deviceString(device, CL_DEVICE_NAME));
+
+  for (uint i = 0; i < numSubDevices; i++) {
+    if (i != subDevice) {
+      status = clReleaseDevice(subDevices[i]);
+      checkError("clReleaseDevice");
+    }
+  }
+  return subDevices[subDevice];
+#else
+  raiseError("Partitioning a device requires OpenCL 1.2");
+  return device;
+#endif
+}
+
+/******************************************************************************/
+//  SELECTING
+/******************************************************************************/
+bool DeviceSelector::matches(std::string name, std::string wanted) {
+  return lowercase(name).find(lowercase(wanted)) != std::string::npos;
+}
+
+/**
+ * Apply a device specification
+ *
+ * Input:   std::string spec  - comma separated key=value pairs, see the header
+ */
+DeviceSelector& DeviceSelector::parse(std::string spec) {
+
+  std::stringstream pairs(spec);
+  std::string pair;
+
+  while (std::getline(pairs, pair, ',')) {
+    if (pair.empty()) {
+      continue;
+    }
+
+    size_t equals = pair.find('=');
+    if (equals == std::string::npos) {
+      raiseError("Expected key=value in device specification, got '" + pair + "'");
+    }
+    std::string key = lowercase(pair.substr(0, equals));
+    std::string value = pair.substr(equals + 1);
+    std::string lower = lowercase(value);
+
+    try {
+      if (key == "platform") {
+        platform(value);
+      } else if (key == "device") {
+        device(value);
+      } else if (key == "type") {
+        if      (lower == "gpu")          { type(CL_DEVICE_TYPE_GPU); }
+        else if (lower == "cpu")          { type(CL_DEVICE_TYPE_CPU); }
+        else if (lower == "accelerator")  { type(CL_DEVICE_TYPE_ACCELERATOR); }
+        else if (lower == "all")          { type(CL_DEVICE_TYPE_ALL); }
+        else { raiseError("Unknown device type '" + value + "'"); }
+      } else if (key == "units") {
+        minComputeUnits(std::stoul(value));
+      } else if (key == "memory") {
+        size_t end;
+        cl_ulong bytes = std::stoull(value, &end);
+        std::string suffix = lowercase(value.substr(end));
+        if      (suffix == "k") { bytes <<= 10; }
+        else if (suffix == "m") { bytes <<= 20; }
+        else if (suffix == "g") { bytes <<= 30; }
+        else if (!suffix.empty()) { raiseError("Unknown memory suffix '" + suffix + "'"); }
+        minMemory(bytes);
+      } else if (key == "index") {
+        index(std::stoul(value));
+      } else if (key == "sub") {
+        subDevice = std::stoul(value);
+      } else if (key == "partition") {
+        if (lower.compare(0, 8, "equally:") == 0) {
+          partitionEqually(std::stoul(value.substr(8)), subDevice);
+        } else if (lower.compare(0, 7, "counts:") == 0) {
+          std::vector<cl_uint> parsed;
+          std::stringstream list(value.substr(7));
+          std::string count;
+          while (std::getline(list, count, '+')) {
+            parsed.push_back(std::stoul(count));
+          }
+          partitionByCounts(parsed, subDevice);
+        }
+        else if (lower == "numa") { partitionByAffinity(CL_DEVICE_AFFINITY_DOMAIN_NUMA, subDevice); }
+        else if (lower == "l1")   { partitionByAffinity(CL_DEVICE_AFFINITY_DOMAIN_L1_CACHE, subDevice); }
+        else if (lower == "l2")   { partitionByAffinity(CL_DEVICE_AFFINITY_DOMAIN_L2_CACHE, subDevice); }
+        else if (lower == "l3")   { partitionByAffinity(CL_DEVICE_AFFINITY_DOMAIN_L3_CACHE, subDevice); }
+        else if (lower == "l4")   { partitionByAffinity(CL_DEVICE_AFFINITY_DOMAIN_L4_CACHE, subDevice); }
+        else if (lower == "next") { partitionByAffinity(CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE, subDevice); }
+        else { raiseError("Unknown partition '" + value + "'"); }
+      } else {
+        raiseError("Unknown key '" + key + "' in device specification");
+      }
+    } catch (std::invalid_argument&) {
+      raiseError("Expected a number for '" + key + "', got '" + value + "'");
+    } catch (std::out_of_range&) {
+      raiseError("The value of '" + key + "' is out of range: '" + value + "'");
+    }
+  }
+
+  return *this;
+}
+
+/**
+ * Find the device which matches the criteria best
+ *
+ * Input:   bool verbose  - report the fallback to the CPU
+ *
+ * Output:  cl_device_id  - the device or, when partitioning, the sub-device
+ *
+ * Effect:  * Applies EASYOPENCL_DEVICE on top of the criteria
+ *          * Ranks the matching devices of all platforms
+ *          * Partitions the chosen device when requested
+ */
+cl_device_id DeviceSelector::select(bool verbose) {
+
+  const char * environment = std::getenv("EASYOPENCL_DEVICE");
+  if (environment != NULL) {
+    parse(environment);
+  }
+
+  // Fetch the different platforms on which we can run our kernel
+  cl_uint numPlatforms = 0;
+  status = clGetPlatformIDs(0, NULL, &numPlatforms);
+  checkError("clGetPlatformIDs");
+
+  if (numPlatforms == 0) {
+    raiseError("No OpenCL platform available");
+  }
+
+  std::vector<cl_platform_id> platforms(numPlatforms);
+  status = clGetPlatformIDs(numPlatforms, &platforms[0], NULL);
+  checkError("clGetPlatformIDs");
+
+  // Without a type, only GPUs and CPUs are considered, like the GPU with CPU fallback
+  cl_device_type wanted = deviceType ? deviceType : (CL_DEVICE_TYPE_GPU | CL_DEVICE_TYPE_CPU);
+
+  std::vector<std::pair<int, cl_device_id>> candidates;
+
+  for (cl_platform_id platform : platforms) {
+    if (!matches(platformString(platform, CL_PLATFORM_NAME), platformName)) {
+      continue;
+    }
+
+    cl_uint numDevices = 0;
+    if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, NULL, &numDevices) != CL_SUCCESS) {
+      continue;
+    }
+    std::vector<cl_device_id> devices(numDevices);
+    status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, numDevices, &devices[0], NULL);
+    checkError("clGetDeviceIDs");
+
+    for (cl_device_id device : devices) {
+      cl_device_type type;
+      cl_uint units;
+      cl_ulong bytes;
+      clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+      clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(units), &units, NULL);
+      clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(bytes), &bytes, NULL);
+
+      if ((type & wanted) && units >= computeUnits && bytes >= memory
+          && matches(deviceString(device, CL_DEVICE_NAME), deviceName)) {
+        candidates.push_back(std::make_pair(typeRank(type), device));
+      }
+    }
+  }
+
+  std::stable_sort(candidates.begin(), candidates.end()
+    , [](const std::pair<int, cl_device_id>& a, const std::pair<int, cl_device_id>& b) {
+      return a.first < b.first;
+    });
+
+  if (candidates.size() <= deviceIndex) {
+    raiseError("No OpenCL device matches the selection (" + std::to_string(candidates.size())
+      + " candidates, index " + std::to_string(deviceIndex) + ")");
+  }
+
+  if (deviceType == 0 && candidates.front().first != typeRank(CL_DEVICE_TYPE_GPU)) {
+    EASYOPENCL_LOG(LOG_INFO, verbose, "No supported GPU device available." << std::endl
+      << "Falling back to using the CPU." << std::endl);
+  }
+
+  return partition(candidates[deviceIndex].second);
+}
@@ -1,4 +1,5 @@
 #include "easyopencl.h"
+#include "typetraits.h"
 
 #include <iostream>
 
@@ -6,107 +7,487 @@
 #include <utility>
 #include <algorithm>
 #include <cstring>
+#include <fstream>
+#include <set>
+#include <type_traits>
 
 /**
  * Construct an EasyOpenCL object
  *
- * Input:   bool printData - sets debug verbosity for the framework
+ * Input:   bool printData            - sets debug verbosity for the framework
+ *          DeviceSelector selector   - which device to use, by default the
+ *                                      first GPU with the CPU as fallback
  *
- * Effects: * Select the first platform available
- *          * Chooses a device (first choice: GPU, fallback: CPU)
+ * Effects: * Select the device (EASYOPENCL_DEVICE overrides the selector)
  *          * If debug verbosity is enabled: print the selected device info
  *          * Create an OpenCL context and an OpenCL CommandQueue
  */
 template<typename T>
-EasyOpenCL<T>::EasyOpenCL(bool printData) {
+EasyOpenCL<T>::EasyOpenCL(bool printData, DeviceSelector selector) {
 
   info = printData;
-  cl_uint numPlatforms;           //the NO. of platforms
 
-  // Fetch the different platforms on which we can run our kernel
-  cl_platform_id platform = NULL;
-  status = clGetPlatformIDs(0, NULL, &numPlatforms);
-  checkError("clGetPlatformIDs");
-
-  // Take the first platform available
-  if (numPlatforms > 0)
-  {
-    cl_platform_id* platforms = (cl_platform_id*) malloc(numPlatforms * sizeof(cl_platform_id));
-    status = clGetPlatformIDs(numPlatforms, platforms, NULL);
-    platform = platforms[0];
-    free(platforms);
-  }
-
-  // Get the devices which are available on said platform
-  cl_uint numDevices = 0;
-  status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 0, NULL, &numDevices);
-
-  if (numDevices)
-  {
-    //Use the first GPU available
-    devices = (cl_device_id*)malloc(numDevices * sizeof(cl_device_id));
-    status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, numDevices, devices, NULL);
-  }
-  else
-  {
-    // If there is no GPU support, fall back to the CPU
-
-    if(info) {
-      std::cout << "No supported GPU device available." << std::endl;
-      std::cout << "Falling back to using the CPU." << std::endl;
-      std::cout << std::endl;
-    }
-
-    status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 0, NULL, &numDevices);
-    devices = (cl_device_id*)malloc(numDevices * sizeof(cl_device_id));
-    status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, numDevices, devices, NULL);
-  }
+  devices = (cl_device_id*)malloc(sizeof(cl_device_id));
+  devices[0] = selector.select(info);
 
   //Print the data of the selected device
   if (info) {
     printDeviceProperty(*devices);
   }
 
+  // The device does not have to be on the first platform, name its own
+  cl_platform_id platform;
+  status = clGetDeviceInfo(devices[0], CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &platform, NULL);
+  checkError("clGetDeviceInfo CL_DEVICE_PLATFORM");
+
+  cl_context_properties properties[] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
+
   //Create an OpenCL context and a command queue
-  context = clCreateContext(NULL, 1, devices, NULL, NULL, &status);
+  context = clCreateContext(properties, 1, devices, NULL, NULL, &status);
   checkError("clCreateContext");
 
+  createCommandQueue();
+  svm.init(&context, &commandQueue, devices[0]);
+}
+
+template<typename T>
+void EasyOpenCL<T>::createCommandQueue() {
 
   #ifdef CL_API_SUFFIX__VERSION_2_0
-    commandQueue = clCreateCommandQueueWithProperties(context, devices[0], 0, &status);
+    cl_queue_properties properties[] = {
+      CL_QUEUE_PROPERTIES, profiling ? (cl_queue_properties)CL_QUEUE_PROFILING_ENABLE : 0, 0
+    };
+    commandQueue = clCreateCommandQueueWithProperties(context, devices[0], properties, &status);
     checkError("clCreateCommandQueueWithProperties");
   #else
-    commandQueue = clCreateCommandQueue(context, devices[0], 0, &status);
+    commandQueue = clCreateCommandQueue(context, devices[0]
+      , profiling ? CL_QUEUE_PROFILING_ENABLE : 0, &status);
     checkError("clCreateCommandQueue");
   #endif
 }
 
+/**
+ * Record the device time of every launch and transfer
+ *
+ * Effect:  Recreates the command queue with CL_QUEUE_PROFILING_ENABLE, the
+ *          kernels keep the queue they were loaded with so this has to be
+ *          called before loading any kernel.
+ */
+template<typename T>
+void EasyOpenCL<T>::enableProfiling() {
+
+  if (profiling) {
+    return;
+  }
+
+  if (kernels.size()) {
+    raiseError("Enable profiling before loading any kernel");
+  }
+
+  status = clReleaseCommandQueue(commandQueue);
+  checkError("clReleaseCommandQueue");
+
+  profiling = true;
+  createCommandQueue();
+}
+
+/**
+ * The time between the start and the end of a profiled command
+ *
+ * Input:   cl_event event  - an event of a command on the profiling queue
+ *
+ * Output:  cl_ulong        - nanoseconds, 0 without profiling
+ */
+template<typename T>
+cl_ulong EasyOpenCL<T>::getDuration(cl_event event) {
+
+  if (!profiling || event == NULL) {
+    return 0;
+  }
+
+  status = clWaitForEvents(1, &event);
+  checkError("clWaitForEvents");
+
+  cl_ulong start, end;
+  status = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+  checkError("clGetEventProfilingInfo start");
+  status = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+  checkError("clGetEventProfilingInfo end");
+
+  return end - start;
+}
+
 template<typename T>
 Kernel<T>& EasyOpenCL<T>::load(std::string id) {
+  return load(id, id);
+}
+
+/**
+ * Load another instance of a kernel
+ *
+ * Input:   std::string id          - the name of this instance
+ *          std::string kernelName  - the entry function, read from kernelName.cl
+ *
+ * Output:  Kernel<T>&              - the instance, with its own bindings
+ *
+ * All instances of a kernel share the program, it is only built once.
+ */
+template<typename T>
+Kernel<T>& EasyOpenCL<T>::load(std::string id, std::string kernelName) {
 
   if(kernels.count(id)) {
     raiseError("Identifier '" + id + "' already exists!");
   }
 
   //Store the kernel in the map
-  kernels.emplace(id, Kernel<T>(id, context, commandQueue, devices, id + ".cl", this));
+  kernels.emplace(id, Kernel<T>(id, context, commandQueue, kernelName + ".cl", this));
   return kernels[id];
 }
 
+/**
+ * Upload a sparse matrix and load the kernel multiplying it with a vector
+ *
+ * Input:   std::string id                  - the name of the kernel
+ *          const SparseMatrix<T>& matrix   - the matrix A, in CSR form
+ *          SparseFormat format             - the layout on the device
+ *
+ * Output:  Kernel<T>&  - computes y = A * x, bind or link x at SpMV::X, y at
+ *                        SpMV::Y is an output of A.getRows() elements
+ *
+ * CSR rows with few non-zeros are handled by one work item each, longer rows
+ * by a group of lanes (a power of two up to 32, near the average row length)
+ * which reduce their partial sums in local memory.
+ */
+template<typename T>
+Kernel<T>& EasyOpenCL<T>::loadSpMV(std::string id, const SparseMatrix<T>& matrix, SparseFormat format) {
+
+  if(kernels.count(id)) {
+    raiseError("Identifier '" + id + "' already exists!");
+  }
+
+  // Up to this many non-zeros per row a work item per row is faster
+  const double scalarRowLength = 4.0;
+
+  uint rows = matrix.getRows();
+  std::string options = TypeTraits<T>::buildOptions();
+  std::string entry;
+  size_t globalSize = rows;
+  size_t groupSize = 0;
+
+  if (format == SparseFormat::CSR && matrix.getAverageRowLength() <= scalarRowLength) {
+    entry = "spmv_csr_scalar";
+
+  } else if (format == SparseFormat::CSR) {
+    entry = "spmv_csr_vector";
+
+    size_t lanes = 2;
+    while (lanes < matrix.getAverageRowLength() && lanes < 32) {
+      lanes *= 2;
+    }
+
+    size_t maxGroupSize;
+    status = clGetDeviceInfo(devices[0], CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &maxGroupSize, NULL);
+    checkError("clGetDeviceInfo CL_DEVICE_MAX_WORK_GROUP_SIZE");
+
+    groupSize = lanes;
+    while (groupSize * 2 <= std::min(maxGroupSize, (size_t)128)) {
+      groupSize *= 2;
+    }
+    lanes = std::min(lanes, groupSize);
+
+    globalSize = (rows * lanes + groupSize - 1) / groupSize * groupSize;
+    options += " -D LANES=" + std::to_string(lanes) + " -D GROUP_SIZE=" + std::to_string(groupSize);
+
+  } else if (format == SparseFormat::ELL) {
+    entry = "spmv_ell";
+
+  } else {
+    entry = "spmv_sliced_ell";
+    options += " -D SLICE_HEIGHT=" + std::to_string(SparseMatrix<T>::SLICE_HEIGHT);
+  }
+
+  kernels.emplace(id, Kernel<T>(id, context, commandQueue, "spmv.cl", this, entry, options));
+  Kernel<T>& kernel = kernels[id];
+
+  if (format == SparseFormat::CSR) {
+    kernel.bindArray(2, matrix.getRowPointers());
+    kernel.bindArray(3, matrix.getColumnIndices());
+    kernel.bindArray(4, matrix.getValues());
+    kernel.template bindScalar<cl_uint>(5, rows);
+
+  } else if (format == SparseFormat::ELL) {
+    std::vector<cl_uint> columns;
+    std::vector<T> values;
+    uint width;
+    matrix.toEll(columns, values, width);
+
+    kernel.bindArray(2, columns);
+    kernel.bindArray(3, values);
+    kernel.template bindScalar<cl_uint>(4, rows);
+    kernel.template bindScalar<cl_uint>(5, width);
+
+  } else {
+    std::vector<cl_uint> sliceOffsets, columns;
+    std::vector<T> values;
+    matrix.toSlicedEll(sliceOffsets, columns, values);
+
+    kernel.bindArray(2, sliceOffsets);
+    kernel.bindArray(3, columns);
+    kernel.bindArray(4, values);
+    kernel.template bindScalar<cl_uint>(5, rows);
+  }
+
+  // The length of y, also when link() binds it again after x was bound
+  kernel.outputLengths[SpMV::Y] = rows;
+  kernel.bindOutput(SpMV::Y, rows);
+  kernel.setWorkSize(globalSize, groupSize);
+  return kernel;
+}
+
+/**
+ * Load a kernel generating random numbers on the device
+ *
+ * Input:   std::string id              - the name of the kernel
+ *          uint length                 - the number of values per evaluation
+ *          Distribution distribution   - uniform in [a, b) or normal (mean a, deviation b)
+ *          cl_ulong seed               - selects the stream
+ *          cl_ulong offset             - the first value of the stream to write
+ *          T a, T b                    - the parameters of the distribution
+ *
+ * Output:  Kernel<T>&  - without inputs, its output (Random::Output) can be
+ *                        linked into a graph like any other buffer
+ *
+ * Value i of the stream only depends on the seed and i (Philox4x32-10), so
+ * the numbers are the same on every device and for every work-group size,
+ * and a stream can be continued by binding a new Random::Offset.
+ */
+template<typename T>
+Kernel<T>& EasyOpenCL<T>::loadRandom(std::string id, uint length, Distribution distribution, cl_ulong seed
+                                    , cl_ulong offset, T a, T b) {
+
+  if(kernels.count(id)) {
+    raiseError("Identifier '" + id + "' already exists!");
+  }
+
+  std::string options = TypeTraits<T>::buildOptions();
+  if (std::is_same<T, double>::value) {
+    options += " -D WORDS_PER_VALUE=2";
+  }
+  if (std::is_integral<T>::value) {
+    options += " -D INTEGER";
+  }
+  if (distribution == Distribution::Normal) {
+    options += " -D NORMAL";
+  }
+
+  kernels.emplace(id, Kernel<T>(id, context, commandQueue, "random.cl", this, "random_fill", options));
+  Kernel<T>& kernel = kernels[id];
+
+  // Without inputs the length is the kernel's, also when link() binds the
+  // output again
+  kernel.vectorSize = length;
+  kernel.bindOutput(Random::Output, length);
+  kernel.template bindScalar<cl_uint>(1, length);
+  kernel.template bindScalar<cl_uint>(2, (cl_uint)seed);
+  kernel.template bindScalar<cl_uint>(3, (cl_uint)(seed >> 32));
+  kernel.template bindScalar<cl_ulong>(Random::Offset, offset);
+  kernel.template bindScalar<T>(5, a);
+  kernel.template bindScalar<T>(6, b);
+
+  // One block of values per work item, one more as the offset does not have
+  // to be aligned to a block
+  size_t perBlock = std::is_same<T, double>::value ? 2 : 4;
+  kernel.setWorkSize((length + perBlock - 1) / perBlock + 1);
+  return kernel;
+}
+
+/**
+ * Read an OpenCL source file and build it for the selected device
+ *
+ * Input:   std::string filename  - the .cl file, embedded or relative to the working directory
+ *          std::string options   - build options passed to the OpenCL compiler
+ *          std::string header    - source code placed in front of the file contents
+ *
+ * Output:  cl_program            - the built program, owned by the framework
+ *
+ * Programs are kept by their source code and options: every kernel instance
+ * (and every primitive) built from the same source shares one cl_program.
+ * Embedded files (see cmake/modules/EmbedKernels.cmake) are used before the
+ * file system, an embedded binary before the source.
+ */
+template<typename T>
+cl_program EasyOpenCL<T>::getProgram(std::string filename, std::string options, std::string header) {
+
+  // A binary is built without options, it can only stand in for a plain kernel
+  const EmbeddedKernel * binary = KernelRegistry::findBinary(filename);
+  if (binary != NULL && options.empty() && header.empty()) {
+
+    std::string key = std::string("binary") + '\0' + filename;
+    auto it = programs.find(key);
+    if (it != programs.end()) {
+      return it->second;
+    }
+
+    cl_program program = buildBinary(binary);
+    if (program != NULL) {
+      programs[key] = program;
+      return program;
+    }
+  }
+
+  return getProgramFromSource(header + getSource(filename), options, filename);
+}
+
+/**
+ * The source of a kernel file, embedded or from the working directory,
+ * with the embedded headers inlined
+ */
+template<typename T>
+std::string EasyOpenCL<T>::getSource(std::string filename) {
+
+  std::string source;
+  if (!KernelRegistry::findSource(filename, source)) {
+
+    // Open the file
+    std::ifstream f(filename);
+    if (!f.good()) {
+      raiseError("Unable to open kernel file: " + filename);
+    }
+
+    // Store the file contents as a std::string using a std::stringstream
+    std::stringstream buffer;
+    buffer << f.rdbuf();
+    source = buffer.str();
+  }
+
+  return KernelRegistry::inlineIncludes(source);
+}
+
+/**
+ * Build a program from its source, once per source and build options
+ *
+ * Input:   std::string fileContents  - the complete source
+ *          std::string options       - the build options
+ *          std::string filename      - the file it came from, for errors
+ */
+template<typename T>
+cl_program EasyOpenCL<T>::getProgramFromSource(std::string fileContents, std::string options, std::string filename) {
+
+  std::string key = options + '\0' + fileContents;
+  auto it = programs.find(key);
+  if (it != programs.end()) {
+    return it->second;
+  }
+
+  cl_program program = buildProgram(fileContents, options, filename);
+  programs[key] = program;
+  return program;
+}
+
+/**
+ * Build an embedded binary
+ *
+ * Output:  cl_program  - the program, NULL when the device rejects the binary
+ */
+template<typename T>
+cl_program EasyOpenCL<T>::buildBinary(const EmbeddedKernel* binary) {
+
+  cl_int binaryStatus;
+  const unsigned char * data = binary->data;
+  size_t size = binary->size;
+  cl_program program = clCreateProgramWithBinary(context, 1, devices, &size, &data, &binaryStatus, &status);
+
+  if (status == CL_SUCCESS && binaryStatus == CL_SUCCESS) {
+    status = clBuildProgram(program, 1, devices, NULL, NULL, NULL);
+    if (status == CL_SUCCESS) {
+      telemetry.count(Telemetry::ProgramBuilds);
+      return program;
+    }
+  }
+
+  EASYOPENCL_LOG(LOG_INFO, info, "The binary " << binary->name << " does not fit the device ("
+    << getErrorString(status) << "), building the source.");
+
+  if (program != NULL) {
+    clReleaseProgram(program);
+  }
+  return NULL;
+}
+
+/**
+ * Write the binary of a kernel for the selected device
+ *
+ * Input:   std::string kernelName  - the kernel, read from kernelName.cl
+ *          std::string filename    - the file to write, embed it with
+ *                                    easyopencl_embed_kernels(... BINARIES)
+ */
+template<typename T>
+void EasyOpenCL<T>::writeBinary(std::string kernelName, std::string filename) {
+
+  cl_program program = getProgram(kernelName + ".cl", "");
+
+  size_t size;
+  status = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &size, NULL);
+  checkError("clGetProgramInfo CL_PROGRAM_BINARY_SIZES");
+
+  std::vector<unsigned char> binary(size);
+  unsigned char * data = &binary[0];
+  status = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &data, NULL);
+  checkError("clGetProgramInfo CL_PROGRAM_BINARIES");
+
+  std::ofstream f(filename, std::ios::binary);
+  if (!f.good()) {
+    raiseError("Unable to open binary file: " + filename);
+  }
+  f.write((const char*)data, size);
+}
+
+template<typename T>
+cl_program EasyOpenCL<T>::buildProgram(std::string fileContents, std::string options, std::string filename) {
+
+  // Convert it to a C-style string
+  const char *source = fileContents.c_str();
+  const size_t length = fileContents.length();
+
+  // Create a cl_program object from the source code string
+  cl_program program = clCreateProgramWithSource(context, 1, &source, &length, &status);
+  checkError("clCreateProgramWithSource");
+
+  // Build the program file into an object file
+  // Headers (.clh) are looked up next to the kernels, in the working directory
+  options = "-I . " + options;
+  status = clBuildProgram(program, 1, devices, options.c_str(), NULL, NULL);
+
+  // On failure, allocate a buffer, fill it with the error message and display it
+  if(status != CL_SUCCESS) {
+    char buffer[10240];
+    clGetProgramBuildInfo(program, devices[0], CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, NULL);
+    std::cerr << buffer << std::endl;
+    clReleaseProgram(program);
+  }
+  checkError("clBuildProgram", filename);
+  telemetry.count(Telemetry::ProgramBuilds);
+
+  return program;
+}
+
 /******************************************************************************/
 //  LINKING KERNELS
 /******************************************************************************/
 template<typename T>
 void EasyOpenCL<T>::link( Kernel<T>& source
                         , Kernel<T>& target
-                        , std::map<uint,uint> links) {
+                        , std::map<uint,uint> links
+                        , Storage storage) {
 
   for(auto& kv : links) {
     uint sourceArgPos = kv.first;
     uint targetArgPos = kv.second;
 
-    // Tell the source to generate an output
-    source.bindOutput(sourceArgPos);
+    // Tell the source to generate an output, a slice is an output already
+    if (!source.isSlice(sourceArgPos)) {
+      source.bindOutput(sourceArgPos, storage);
+    }
 
     // Tell the target that an input is promised
     // coming from 'source' , argument position 'sourceArgPos'
@@ -118,14 +499,17 @@ template<typename T>
 void EasyOpenCL<T>::link( Kernel<T>& source
                         , Kernel<T>& target
                         , uint size
-                        , std::map<uint,uint> links) {
+                        , std::map<uint,uint> links
+                        , Storage storage) {
 
   for(auto& kv : links) {
     uint sourceArgPos = kv.first;
     uint targetArgPos = kv.second;
 
-    // Tell the source to generate an output
-    source.bindOutput(sourceArgPos, size);
+    // Tell the source to generate an output, a slice is an output already
+    if (!source.isSlice(sourceArgPos)) {
+      source.bindOutput(sourceArgPos, size, storage);
+    }
 
     // Tell the target that an input is promised
     // coming from 'source' , argument position 'sourceArgPos'
@@ -135,6 +519,334 @@ void EasyOpenCL<T>::link( Kernel<T>& source
 
 }
 
+/******************************************************************************/
+//  PLANNING
+/******************************************************************************/
+template<typename T>
+MemoryPlan EasyOpenCL<T>::plan(Kernel<T>& root) {
+  MemoryPlanner<T> planner(this);
+  return planner.plan(root);
+}
+
+template<typename T>
+GraphAnalysis<T> EasyOpenCL<T>::analyse(Kernel<T>& root) {
+  return GraphAnalysis<T>(root);
+}
+
+/******************************************************************************/
+//  MEMORY BUDGET
+/******************************************************************************/
+template<typename T>
+size_t EasyOpenCL<T>::getDeviceMemory() {
+  std::map<cl_mem, uint> users;
+  std::set<cl_mem> pinned;
+  return countDeviceMemory(users, pinned);
+}
+
+/**
+ * The device memory of the buffers bound to all kernels
+ *
+ * Input:   std::map<cl_mem, uint>& users - filled with the bindings per memory object
+ *          std::set<cl_mem>& pinned      - filled with the parents of slices
+ *
+ * Output:  size_t  - in bytes, memory objects shared by several bindings
+ *                    (memory planning, iterate()) count once
+ */
+template<typename T>
+size_t EasyOpenCL<T>::countDeviceMemory(std::map<cl_mem, uint>& users, std::set<cl_mem>& pinned) {
+
+  size_t bytes = 0;
+
+  for (auto& kv : kernels) {
+    for (auto& buffer : kv.second.boundBuffers) {
+      if (!buffer.second.isSpilled() && users[buffer.second]++ == 0) {
+        bytes += buffer.second.getBytes();
+      }
+    }
+    for (auto& promise : kv.second.boundPromises) {
+      if (promise.second.getView()) {
+        pinned.insert(promise.second.getView()->getParent());
+      }
+    }
+  }
+  return bytes;
+}
+
+/**
+ * Get the buffers of the next launch or allocation onto the device
+ *
+ * Input:   Kernel<T>& next   - the kernel about to launch, or which just allocated
+ *          bool allocated    - whether a buffer was just created
+ *
+ * Effect:  * Restores the spilled buffers the kernel reads or writes
+ *          * Updates the peak device memory
+ *          * Above the memory budget, spills the least recently used buffers
+ *            which the kernel does not use, until the budget is met. Slices,
+ *            their parents and memory shared by several bindings stay.
+ */
+template<typename T>
+void EasyOpenCL<T>::reserveMemory(Kernel<T>& next, bool allocated) {
+
+  // Nothing was spilled and nothing changed, keep launches cheap
+  if (!allocated && memoryBudget == 0 && spilledBuffers == 0) {
+    return;
+  }
+
+  memoryClock++;
+
+  std::set<cl_mem> needed;
+  for (auto& kv : next.boundBuffers) {
+    BoundBuffer& buffer = next.prepareBuffer(kv.first);
+    buffer.touch(memoryClock);
+    needed.insert(buffer);
+  }
+  // The sources of the promises may not have bound their buffers before a launch
+  if (!allocated) {
+    for (auto& kv : next.boundPromises) {
+      BoundBuffer& buffer = next.prepareBuffer(kv.first);
+      buffer.touch(memoryClock);
+      needed.insert(buffer.isView() ? buffer.getParent() : (cl_mem)buffer);
+    }
+  }
+
+  std::map<cl_mem, uint> users;
+  std::set<cl_mem> pinned;
+  size_t bytes = countDeviceMemory(users, pinned);
+
+  if (memoryBudget && bytes > memoryBudget) {
+
+    // Least recently used first
+    std::vector<std::pair<uint64_t, std::pair<Kernel<T>*, uint>>> candidates;
+    for (auto& kv : kernels) {
+      for (auto& buffer : kv.second.boundBuffers) {
+        cl_mem memObject = buffer.second;
+        if (!buffer.second.isSpilled() && users[memObject] == 1 && !pinned.count(memObject) && !needed.count(memObject)) {
+          candidates.push_back({ buffer.second.getLastUse(), { &kv.second, buffer.first } });
+        }
+      }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (auto& candidate : candidates) {
+      if (bytes <= memoryBudget) {
+        break;
+      }
+      Kernel<T>& kernel = *candidate.second.first;
+      bytes -= kernel.boundBuffers.at(candidate.second.second).getBytes();
+      kernel.spill(candidate.second.second);
+    }
+
+    if (bytes > memoryBudget) {
+      EASYOPENCL_LOG(LOG_INFO, info, "'" << next.getId() << "' needs " << bytes
+        << " bytes of device memory, more than the budget of " << memoryBudget << " bytes");
+    }
+  }
+
+  peakDeviceMemory = std::max(peakDeviceMemory, bytes);
+}
+
+/******************************************************************************/
+//  ITERATING
+/******************************************************************************/
+template<typename T>
+void EasyOpenCL<T>::iterate(Kernel<T>& kernel, uint inPos, uint outPos, uint count) {
+  iterate(kernel, inPos, kernel, outPos, count);
+}
+
+/**
+ * Run a kernel or a chain of kernels repeatedly, feeding the output back
+ *
+ * Input:   Kernel<T>& first  - the kernel reading the state
+ *          uint inPos        - the buffer of 'first' holding the state
+ *          Kernel<T>& last   - the kernel writing the next state (can be 'first')
+ *          uint outPos       - the buffer of 'last' receiving it
+ *          uint count        - the number of iterations
+ *
+ * Effect:  * Runs the dependencies outside of the loop once
+ *          * Enqueues 'first', 'last' and every kernel between them 'count'
+ *            times, swapping the two buffers in between: nothing is read back
+ *            and the host never waits
+ *          * The final state is in the buffer at 'outPos' of 'last'
+ */
+template<typename T>
+void EasyOpenCL<T>::iterate(Kernel<T>& first, uint inPos, Kernel<T>& last, uint outPos, uint count) {
+
+  std::vector<Kernel<T>*> loop = prepareLoop(first, inPos, last, outPos);
+
+  for (uint i = 0; i < count; i++) {
+    if (i != 0) {
+      swapLoopBuffers(loop, first, inPos, last, outPos);
+    }
+    for (Kernel<T>* kernel : loop) {
+      kernel->launch();
+    }
+  }
+
+  status = clFlush(commandQueue);
+  checkError("clFlush");
+}
+
+template<typename T>
+uint EasyOpenCL<T>::iterateUntil(Kernel<T>& kernel, uint inPos, uint outPos, uint flagPos
+                                , uint maxIterations, uint checkInterval) {
+  return iterateUntil(kernel, inPos, kernel, outPos, flagPos, maxIterations, checkInterval);
+}
+
+/**
+ * Iterate until the kernels report convergence
+ *
+ * Input:   Kernel<T>& first, uint inPos, Kernel<T>& last, uint outPos
+ *                              - the loop, as for iterate()
+ *          uint flagPos        - binds a __global int* flag to 'last' at this position
+ *          uint maxIterations  - the iteration limit
+ *          uint checkInterval  - iterations between two reads of the flag
+ *
+ * Output:  uint                - the number of iterations run
+ *
+ * The flag is set to 1 before every checked iteration, and every work item
+ * which has not converged yet writes 0 to it. When it is still set after
+ * the iteration, the loop stops. Only checked iterations wait for the device.
+ */
+template<typename T>
+uint EasyOpenCL<T>::iterateUntil(Kernel<T>& first, uint inPos, Kernel<T>& last, uint outPos, uint flagPos
+                                , uint maxIterations, uint checkInterval) {
+
+  // Must outlive the non-blocking writes
+  static const cl_int converged = 1;
+
+  if (checkInterval == 0) {
+    raiseError("The check interval has to be at least 1");
+  }
+
+  cl_mem flag = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int), NULL, &status);
+  checkError("clCreateBuffer convergence flag");
+  telemetry.count(Telemetry::BufferAllocations);
+
+  status = clSetKernelArg(last, flagPos, sizeof(cl_mem), (void*)&flag);
+  checkError("clSetKernelArg convergence flag", flagPos);
+  telemetry.count(Telemetry::ArgumentSets);
+
+  last.erase(flagPos);
+  last.boundBuffers.emplace(flagPos, BoundBuffer(flag, 1, sizeof(cl_int)));
+
+  std::vector<Kernel<T>*> loop = prepareLoop(first, inPos, last, outPos);
+
+  uint iteration = 0;
+  while (iteration < maxIterations) {
+
+    if (iteration != 0) {
+      swapLoopBuffers(loop, first, inPos, last, outPos);
+    }
+
+    bool check = (iteration + 1) % checkInterval == 0 || iteration + 1 == maxIterations;
+
+    if (check) {
+      status = clEnqueueWriteBuffer(commandQueue, flag, CL_FALSE, 0, sizeof(cl_int), &converged, 0, NULL, NULL);
+      checkError("clEnqueueWriteBuffer convergence flag");
+    }
+
+    for (Kernel<T>* kernel : loop) {
+      kernel->launch();
+    }
+    iteration++;
+
+    if (check) {
+      cl_int result;
+      status = clEnqueueReadBuffer(commandQueue, flag, CL_TRUE, 0, sizeof(cl_int), &result, 0, NULL, NULL);
+      checkError("clEnqueueReadBuffer convergence flag");
+      telemetry.count(Telemetry::BytesFromDevice, sizeof(cl_int));
+
+      if (result) {
+        break;
+      }
+    }
+  }
+
+  EASYOPENCL_LOG(LOG_DEBUG, info, "Iterated '" << first.getId() << "' to '" << last.getId()
+    << "' " << iteration << " times.");
+
+  return iteration;
+}
+
+/**
+ * The kernels to launch every iteration, in execution order
+ *
+ * Effect:  * Checks that the state buffers can be swapped
+ *          * Evaluates the dependencies outside of the loop which have not run
+ *          * Binds the current buffers of every kernel in the loop
+ */
+template<typename T>
+std::vector<Kernel<T>*> EasyOpenCL<T>::prepareLoop(Kernel<T>& first, uint inPos, Kernel<T>& last, uint outPos) {
+
+  auto in = first.boundBuffers.find(inPos);
+  auto out = last.boundBuffers.find(outPos);
+
+  if (in == first.boundBuffers.end() || out == last.boundBuffers.end()) {
+    raiseError("Iterating needs buffers bound to '" + first.getId() + "' (" + std::to_string(inPos)
+      + ") and '" + last.getId() + "' (" + std::to_string(outPos) + "), not promises");
+  }
+  if (in->second.isView() || out->second.isView()
+      || in->second.getBytes() != out->second.getBytes()
+      || in->second.getStorage() != out->second.getStorage()) {
+    raiseError("The buffers iterated over need the same size and storage");
+  }
+
+  std::vector<Kernel<T>*> order;
+  std::set<Kernel<T>*> visited;
+  last.collectExecutionOrder(order, visited);
+
+  // The loop: 'first' and everything depending on it up to 'last'
+  std::set<Kernel<T>*> inLoop { &first };
+  std::vector<Kernel<T>*> loop;
+
+  for (Kernel<T>* kernel : order) {
+    for (auto& kv : kernel->boundPromises) {
+      if (inLoop.count(kv.second.getSourceKernel())) {
+        inLoop.insert(kernel);
+      }
+    }
+
+    if (inLoop.count(kernel)) {
+      loop.push_back(kernel);
+    } else if (kernel->getExecutionCount() == 0) {
+      kernel->evaluate();
+    }
+  }
+
+  if (inLoop.count(&last) == 0) {
+    raiseError("'" + last.getId() + "' does not depend on '" + first.getId() + "'");
+  }
+
+  for (Kernel<T>* kernel : loop) {
+    kernel->checkArguments();
+    for (auto& kv : kernel->boundPromises) {
+      kernel->setBufferArgument(kv.first);
+    }
+  }
+
+  return loop;
+}
+
+/**
+ * Make the last output the next input
+ */
+template<typename T>
+void EasyOpenCL<T>::swapLoopBuffers(std::vector<Kernel<T>*>& loop, Kernel<T>& first, uint inPos
+                                    , Kernel<T>& last, uint outPos) {
+
+  std::swap(first.boundBuffers.at(inPos).getMemObject(), last.boundBuffers.at(outPos).getMemObject());
+
+  first.setBufferArgument(inPos);
+  last.setBufferArgument(outPos);
+
+  // Promises of the loop may point at either buffer
+  for (Kernel<T>* kernel : loop) {
+    for (auto& kv : kernel->boundPromises) {
+      kernel->setBufferArgument(kv.first);
+    }
+  }
+}
+
 /******************************************************************************/
 //  EVALUATING
 /******************************************************************************/
@@ -160,12 +872,27 @@ void EasyOpenCL<T>::cleanup() {
 
     Kernel<T>& kernel = kv.second;
 
+    kernel.releaseVariants();
     status = clReleaseKernel(kernel);
     checkError("clReleaseKernel");
 
+    if (kernel.launchEvent != NULL) {
+      status = clReleaseEvent(kernel.launchEvent);
+      checkError("clReleaseEvent");
+    }
+
     kernel.releaseMemObjects();
   }
 
+  builtins.release();
+  svm.cleanup();
+
+  for (auto& kv : programs) {
+    status = clReleaseProgram(kv.second);
+    checkError("clReleaseProgram");
+  }
+  programs.clear();
+
   status = clReleaseCommandQueue(commandQueue);
   checkError("clReleaseCommandQueue");
   status = clReleaseContext(context);
@@ -173,6 +900,11 @@ void EasyOpenCL<T>::cleanup() {
 
   if (devices != NULL)
   {
+    // Releases a sub-device, a no-op for a device of the platform
+    #ifdef CL_VERSION_1_2
+      status = clReleaseDevice(devices[0]);
+      checkError("clReleaseDevice");
+    #endif
     free(devices);
     devices = NULL;
   }
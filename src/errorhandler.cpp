@@ -3,6 +3,8 @@
 #include <exception>
 #include <stdexcept>
 
+static thread_local std::string lastError;
+
 void ErrorHandler::raiseError(std::string errorString) {
   throw std::runtime_error(errorString.c_str());
 }
@@ -10,7 +12,38 @@ void ErrorHandler::raiseError(std::string errorString) {
 void ErrorHandler::checkError(std::string errorLocation) {
   if (status != CL_SUCCESS)
   {
-    raiseError(errorLocation + '\t' + getErrorString(status));
+    throw OpenCLError(errorLocation + '\t' + getErrorString(status), status);
+  }
+}
+
+/**
+ * Format the message of a failed call and throw it
+ *
+ * Input:   const char* site  - what was called
+ *          argument          - the argument position, a kernel name, ...
+ */
+void ErrorHandler::failed(const char* site) {
+  throw OpenCLError(site + ('\t' + getErrorString(status)), status);
+}
+
+void ErrorHandler::failed(const char* site, long long argument) {
+  failed(site, std::to_string(argument));
+}
+
+void ErrorHandler::failed(const char* site, const std::string& argument) {
+  throw OpenCLError(site + (" " + argument) + '\t' + getErrorString(status), status);
+}
+
+const std::string& ErrorHandler::getLastError() {
+  return lastError;
+}
+
+void ErrorHandler::setLastError(const char* message) noexcept {
+  try {
+    lastError = message;
+  }
+  catch (...) {
+    // Out of memory, keep the previous message
   }
 }
 
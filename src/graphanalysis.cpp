@@ -0,0 +1,213 @@
+#include "graphanalysis.h"
+#include "easyopencl.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+/**
+ * Escape the characters which have a meaning in a record label
+ */
+static std::string escapeRecord(std::string text) {
+  std::string escaped;
+  for (char c : text) {
+    if (std::string("{}|<>\"").find(c) != std::string::npos) {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+static std::string milliseconds(cl_ulong ns) {
+  std::stringstream out;
+  out << std::fixed << std::setprecision(3) << ns / 1e6 << " ms";
+  return out.str();
+}
+
+/**
+ * Find the critical path of the graph evaluating 'root' runs
+ *
+ * Input:   Kernel<T>& root - the kernel which is (or was) evaluated
+ *
+ * Effect:  * Orders the graph like evaluate() runs it
+ *          * Forward pass: the earliest start of a kernel is the latest finish
+ *            of its dependencies
+ *          * Backward pass: the latest finish of a kernel is the earliest
+ *            latest start of the kernels depending on it
+ *          * Walks back from the root along dependencies without slack
+ */
+template<typename T>
+GraphAnalysis<T>::GraphAnalysis(Kernel<T>& root) {
+
+  profiled = root.framework->profiling;
+
+  std::vector<Kernel<T>*> order;
+  std::set<Kernel<T>*> visited;
+  root.collectExecutionOrder(order, visited);
+
+  for (Kernel<T>* kernel : order) {
+    Node node;
+    node.kernel = kernel;
+
+    if (profiled) {
+      node.executionTime = kernel->getExecutionTime();
+      node.transferTime = kernel->getLastTransferTime();
+      node.weight = node.executionTime + node.transferTime;
+    } else {
+      node.weight = 1;
+    }
+
+    index[kernel] = nodes.size();
+    nodes.push_back(node);
+  }
+
+  // Forward pass, the order has every dependency before its users
+  for (Node& node : nodes) {
+    for (auto& kv : node.kernel->boundPromises) {
+      Node& source = nodes[index.at(kv.second.getSourceKernel())];
+      node.earliestStart = std::max(node.earliestStart, source.earliestFinish);
+    }
+    node.earliestFinish = node.earliestStart + node.weight;
+  }
+
+  // The root runs last and nothing depends on it
+  length = nodes.back().earliestFinish;
+
+  // Backward pass
+  for (Node& node : nodes) {
+    node.latestFinish = length;
+  }
+  for (size_t i = nodes.size(); i-- > 0;) {
+    Node& node = nodes[i];
+    node.latestStart = node.latestFinish - node.weight;
+
+    for (auto& kv : node.kernel->boundPromises) {
+      Node& source = nodes[index.at(kv.second.getSourceKernel())];
+      source.latestFinish = std::min(source.latestFinish, node.latestStart);
+    }
+  }
+
+  // Walk back from the root, always to a dependency which finishes just in time
+  Node * current = &nodes.back();
+  while (current) {
+    current->critical = true;
+    criticalPath.push_back(current->kernel);
+
+    Node * next = NULL;
+    for (auto& kv : current->kernel->boundPromises) {
+      Node& source = nodes[index.at(kv.second.getSourceKernel())];
+      if (source.getSlack() == 0 && source.earliestFinish == current->earliestStart) {
+        next = &source;
+        break;
+      }
+    }
+    current = next;
+  }
+  std::reverse(criticalPath.begin(), criticalPath.end());
+}
+
+/**
+ * The graph in the Graphviz dot language
+ *
+ * Output:  std::string - render with eg. `dot -Tsvg graph.dot -o graph.svg`
+ */
+template<typename T>
+std::string GraphAnalysis<T>::toDot() {
+
+  std::stringstream dot;
+  dot << "digraph EasyOpenCL {" << std::endl;
+  dot << "  rankdir=TB;" << std::endl;
+  dot << "  node [shape=record, fontname=\"monospace\"];" << std::endl;
+
+  for (Node& node : nodes) {
+    Kernel<T>& kernel = *node.kernel;
+
+    // One port per bound argument, in argument order
+    std::map<uint, std::string> ports;
+    for (auto& kv : kernel.boundScalars) {
+      ports[kv.first] = "scalar";
+    }
+    for (auto& kv : kernel.boundBuffers) {
+      ports[kv.first] = std::to_string(kv.second.getBytes()) + " B";
+    }
+    for (auto& kv : kernel.boundPromises) {
+      ports[kv.first] = std::to_string(kernel.resolveBuffer(kv.first, false).getBytes()) + " B";
+    }
+
+    std::stringstream label;
+    label << "{" << escapeRecord(kernel.getId()) << "|{";
+    for (auto it = ports.begin(); it != ports.end(); ++it) {
+      if (it != ports.begin()) {
+        label << "|";
+      }
+      label << "<a" << it->first << "> " << it->first << ": " << escapeRecord(it->second);
+    }
+    label << "}|";
+
+    if (profiled) {
+      label << "exec " << escapeRecord(milliseconds(node.executionTime))
+            << "\\ntransfer " << escapeRecord(milliseconds(node.transferTime))
+            << "\\nslack " << escapeRecord(milliseconds(node.getSlack()));
+    } else {
+      label << "slack " << node.getSlack();
+    }
+    label << "}";
+
+    dot << "  k" << index[node.kernel] << " [label=\"" << label.str() << "\"";
+    if (node.critical) {
+      dot << ", color=red, penwidth=2";
+    }
+    dot << "];" << std::endl;
+  }
+
+  for (Node& node : nodes) {
+    Kernel<T>& kernel = *node.kernel;
+
+    for (auto& kv : kernel.boundPromises) {
+      BoundPromise<T>& promise = kv.second;
+      Kernel<T> * source = promise.getSourceKernel();
+
+      std::string label;
+      if (promise.getView()) {
+        BoundBuffer& view = *promise.getView();
+        label = "slice [" + std::to_string(view.getOffset()) + ", "
+          + std::to_string(view.getOffset() + view.getSize()) + ")";
+      } else {
+        label = std::to_string(kernel.resolveBuffer(kv.first, false).getBytes()) + " B";
+      }
+
+      // An edge is critical when it connects two consecutive kernels of the path
+      auto it = std::find(criticalPath.begin(), criticalPath.end(), source);
+      bool critical = it != criticalPath.end() && it + 1 != criticalPath.end() && *(it + 1) == node.kernel;
+
+      dot << "  k" << index[source] << ":a" << promise.getSourceArgPos()
+          << " -> k" << index[node.kernel] << ":a" << kv.first
+          << " [label=\"" << label << "\"";
+      if (critical) {
+        dot << ", color=red, penwidth=2";
+      }
+      dot << "];" << std::endl;
+    }
+  }
+
+  dot << "}" << std::endl;
+  return dot.str();
+}
+
+template<typename T>
+void GraphAnalysis<T>::writeDot(std::string filename) {
+
+  std::ofstream f(filename);
+  if (!f.good()) {
+    raiseError("Unable to open dot file: " + filename);
+  }
+  f << toDot();
+}
+
+
+template class GraphAnalysis<float>;
+template class GraphAnalysis<int>;
+template class GraphAnalysis<double>;
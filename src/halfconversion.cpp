@@ -0,0 +1,157 @@
+#include "halfconversion.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #include <immintrin.h>
+  #define HAVE_F16C_DISPATCH
+#endif
+
+static inline uint32_t bitsOf(float f) {
+  uint32_t u;
+  std::memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+static inline float floatOf(uint32_t u) {
+  float f;
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+/*******************************************************/
+//  Scalar conversions
+//  From: https://gist.github.com/rygorous/2156668
+/*******************************************************/
+static inline uint16_t toHalf(float value) {
+
+  const uint32_t f32infinity = 255u << 23;
+  const uint32_t f16max = (127u + 16u) << 23;
+  const uint32_t denormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+  uint32_t x = bitsOf(value);
+  uint32_t sign = x & 0x80000000u;
+  x ^= sign;
+
+  uint16_t h;
+  if (x >= f16max) {
+    // Infinity or NaN (all exponent bits set)
+    h = (x > f32infinity) ? 0x7e00 : 0x7c00;
+  } else if (x < (113u << 23)) {
+    // Subnormal or zero: let the FPU align the mantissa bits and round
+    h = (uint16_t)(bitsOf(floatOf(x) + floatOf(denormMagic)) - denormMagic);
+  } else {
+    // Normal: rebias the exponent and round to nearest even
+    uint32_t mantissaOdd = (x >> 13) & 1;
+    x -= (112u << 23);
+    x += 0xfff + mantissaOdd;
+    h = (uint16_t)(x >> 13);
+  }
+
+  return h | (uint16_t)(sign >> 16);
+}
+
+static inline float fromHalf(uint16_t h) {
+
+  const uint32_t shiftedExponent = 0x7c00u << 13;
+  const float magic = floatOf(113u << 23);
+
+  uint32_t x = (uint32_t)(h & 0x7fff) << 13;
+  uint32_t exponent = x & shiftedExponent;
+  x += (127u - 15u) << 23;
+
+  if (exponent == shiftedExponent) {
+    // Infinity or NaN
+    x += (128u - 16u) << 23;
+  } else if (exponent == 0) {
+    // Zero or subnormal, renormalise
+    x += 1u << 23;
+    x = bitsOf(floatOf(x) - magic);
+  }
+
+  return floatOf(x | ((uint32_t)(h & 0x8000) << 16));
+}
+
+/*******************************************************/
+//  F16C versions, selected at runtime
+/*******************************************************/
+#ifdef HAVE_F16C_DISPATCH
+__attribute__((target("avx,f16c")))
+static void floatToHalfF16C(const float* input, uint16_t* output, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128((__m128i*)(output + i), h);
+  }
+  for (; i < n; i++) {
+    output[i] = toHalf(input[i]);
+  }
+}
+
+__attribute__((target("avx,f16c")))
+static void halfToFloatF16C(const uint16_t* input, float* output, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i h = _mm_loadu_si128((const __m128i*)(input + i));
+    _mm256_storeu_ps(output + i, _mm256_cvtph_ps(h));
+  }
+  for (; i < n; i++) {
+    output[i] = fromHalf(input[i]);
+  }
+}
+
+// The conversions use 256 bit registers, F16C alone is not enough. The avx
+// check includes the operating system saving them (XGETBV).
+static bool hasF16C() {
+  static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c"));
+  return supported;
+}
+#endif
+
+/*******************************************************/
+//  Half precision
+/*******************************************************/
+void floatToHalf(const float* input, uint16_t* output, size_t n) {
+#ifdef HAVE_F16C_DISPATCH
+  if (hasF16C()) {
+    floatToHalfF16C(input, output, n);
+    return;
+  }
+#endif
+  for (size_t i = 0; i < n; i++) {
+    output[i] = toHalf(input[i]);
+  }
+}
+
+void halfToFloat(const uint16_t* input, float* output, size_t n) {
+#ifdef HAVE_F16C_DISPATCH
+  if (hasF16C()) {
+    halfToFloatF16C(input, output, n);
+    return;
+  }
+#endif
+  for (size_t i = 0; i < n; i++) {
+    output[i] = fromHalf(input[i]);
+  }
+}
+
+/*******************************************************/
+//  bfloat16: the upper half of a float
+//  Plain integer loops, left to the auto-vectoriser
+/*******************************************************/
+void floatToBFloat16(const float* input, uint16_t* output, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    uint32_t x = bitsOf(input[i]);
+    uint32_t rounded = (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+
+    // Keep NaNs quiet instead of letting the rounding turn them into infinity
+    bool nan = (x & 0x7fffffffu) > 0x7f800000u;
+    output[i] = nan ? (uint16_t)((x >> 16) | 0x40) : (uint16_t)rounded;
+  }
+}
+
+void bfloat16ToFloat(const uint16_t* input, float* output, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    output[i] = floatOf((uint32_t)input[i] << 16);
+  }
+}
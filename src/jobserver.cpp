@@ -0,0 +1,731 @@
+#include "jobserver.h"
+#include "easyopencl.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Writes to a client which went away must not kill the server
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+/*******************************************************/
+//  Wire format
+//
+//  Request:  magic, element size, element count, number of
+//            kernels, the kernel names, the shared memory name
+//  Reply:    status (0 for success), message
+//
+//  Numbers are uint32_t, strings a length and their bytes.
+//  Client and server run on the same machine.
+/*******************************************************/
+static const uint32_t JOB_MAGIC = 0x4c434f45;   // "EOCL"
+static const uint32_t MAX_STRING = 255;
+static const uint32_t MAX_STAGES = 64;
+
+static bool sendAll(int fd, const void* data, size_t size) {
+  const char * bytes = (const char*)data;
+  while (size > 0) {
+    ssize_t sent = send(fd, bytes, size, SEND_FLAGS);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    bytes += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+static bool receiveAll(int fd, void* data, size_t size) {
+  char * bytes = (char*)data;
+  while (size > 0) {
+    ssize_t received = recv(fd, bytes, size, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    bytes += received;
+    size -= received;
+  }
+  return true;
+}
+
+static bool sendNumber(int fd, uint32_t number) {
+  return sendAll(fd, &number, sizeof(number));
+}
+
+static bool receiveNumber(int fd, uint32_t& number) {
+  return receiveAll(fd, &number, sizeof(number));
+}
+
+static bool sendString(int fd, const std::string& s) {
+  return sendNumber(fd, s.size()) && sendAll(fd, s.data(), s.size());
+}
+
+static bool receiveString(int fd, std::string& s) {
+  uint32_t length;
+  if (!receiveNumber(fd, length) || length > MAX_STRING) {
+    return false;
+  }
+  s.resize(length);
+  return length == 0 || receiveAll(fd, &s[0], length);
+}
+
+// The server reads requests from the bytes a client sent so far
+class RequestReader {
+public:
+  RequestReader(const std::string& bytes_) : bytes(bytes_) {}
+
+  // false when the bytes end before the value
+  bool number(uint32_t& number) {
+    if (bytes.size() - position < sizeof(number)) {
+      return false;
+    }
+    memcpy(&number, &bytes[position], sizeof(number));
+    position += sizeof(number);
+    return true;
+  }
+
+  bool string(std::string& s) {
+    uint32_t length;
+    if (!number(length)) {
+      return false;
+    }
+    if (length > MAX_STRING) {
+      malformed = true;
+      return false;
+    }
+    if (bytes.size() - position < length) {
+      return false;
+    }
+    s.assign(bytes, position, length);
+    position += length;
+    return true;
+  }
+
+  const std::string& bytes;
+  size_t position = 0;
+  bool malformed = false;
+};
+
+// Kernel names become file names, keep them to identifiers
+static bool isIdentifier(const std::string& name) {
+  if (name.empty()) {
+    return false;
+  }
+  for (char c : name) {
+    if (!(isalnum((unsigned char)c) || c == '_')) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Shared memory names are unique per process, several clients may run in one
+static std::atomic<uint> sharedMemoryCounter(0);
+
+static sockaddr_un socketAddress(const std::string& path) {
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  return address;
+}
+
+/******************************************************************************/
+//  SERVER
+/******************************************************************************/
+/**
+ * Listen for clients
+ *
+ * Input:   EasyOpenCL<T>& framework_  - owns the context the jobs run in
+ *          std::string socketPath_    - the Unix domain socket, replaced if it exists
+ */
+template<typename T>
+JobServer<T>::JobServer(EasyOpenCL<T>& framework_, std::string socketPath_) {
+
+  framework = &framework_;
+  socketPath = socketPath_;
+
+  if (socketPath.size() >= sizeof(sockaddr_un().sun_path)) {
+    raiseError("The socket path '" + socketPath + "' is too long");
+  }
+
+  listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    raiseError("Unable to create a socket: " + std::string(strerror(errno)));
+  }
+
+  // A socket left behind by a previous server
+  unlink(socketPath.c_str());
+
+  sockaddr_un address = socketAddress(socketPath);
+  if (bind(listener, (sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 64) < 0) {
+    std::string reason = strerror(errno);
+    close(listener);
+    raiseError("Unable to listen on '" + socketPath + "': " + reason);
+  }
+}
+
+template<typename T>
+JobServer<T>::~JobServer() {
+
+  // No errors from a destructor
+  for (int client : clients) {
+    close(client);
+  }
+  for (Job& job : pending) {
+    unmap(job);
+  }
+  if (listener >= 0) {
+    close(listener);
+    unlink(socketPath.c_str());
+  }
+
+  for (auto& kv : kernels) {
+    clReleaseKernel(kv.second);
+  }
+  for (auto& kv : bufferPool) {
+    clReleaseMemObject(kv.second);
+  }
+}
+
+/**
+ * The event loop
+ *
+ * Effect:  Accepts clients and reads their jobs. Once the oldest waiting job
+ *          is older than the batch window (or enough elements are waiting),
+ *          all waiting jobs run, batched by pipeline.
+ */
+template<typename T>
+void JobServer<T>::serve() {
+
+  stopping = false;
+
+  while (!stopping) {
+
+    // Sleep until the batch window of the waiting jobs closes
+    int timeout = 100;
+    if (!pending.empty()) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        firstPending + batchWindow - std::chrono::steady_clock::now());
+      timeout = std::max(0, (int)remaining.count());
+    }
+
+    std::vector<pollfd> fds;
+    fds.push_back(pollfd { listener, POLLIN, 0 });
+    for (int client : clients) {
+      fds.push_back(pollfd { client, POLLIN, 0 });
+    }
+
+    int ready = poll(&fds[0], fds.size(), timeout);
+    if (ready < 0 && errno != EINTR) {
+      raiseError("poll: " + std::string(strerror(errno)));
+    }
+
+    if (ready > 0) {
+      if (fds[0].revents & POLLIN) {
+        int client = accept(listener, NULL, NULL);
+        if (client >= 0) {
+          fcntl(client, F_SETFL, fcntl(client, F_GETFL, 0) | O_NONBLOCK);
+          clients.push_back(client);
+        }
+      }
+
+      for (size_t i = 1; i < fds.size(); i++) {
+        if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+          if (!receive(fds[i].fd)) {
+            disconnect(fds[i].fd);
+          }
+        }
+      }
+    }
+
+    size_t waiting = 0;
+    for (Job& job : pending) {
+      waiting += job.count;
+    }
+
+    if (!pending.empty() && (std::chrono::steady_clock::now() >= firstPending + batchWindow
+                             || waiting >= maxBatchSize)) {
+      runBatches();
+    }
+  }
+}
+
+/**
+ * Read what a client sent
+ *
+ * Output:  bool  - false when the client hung up or sent garbage
+ *
+ * Effect:  Complete requests become jobs, the start of a request waits for
+ *          the rest of it to arrive
+ */
+template<typename T>
+bool JobServer<T>::receive(int client) {
+
+  std::string& bytes = partial[client];
+
+  char chunk[4096];
+  while (true) {
+    ssize_t received = recv(client, chunk, sizeof(chunk), 0);
+    if (received > 0) {
+      bytes.append(chunk, received);
+    } else if (received < 0 && errno == EINTR) {
+      continue;
+    } else if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else {
+      return false;
+    }
+  }
+
+  while (!bytes.empty()) {
+    size_t used = 0;
+    Request request = readRequest(client, bytes, used);
+    if (request == Request::Malformed) {
+      return false;
+    }
+    if (request == Request::Incomplete) {
+      break;
+    }
+    bytes.erase(0, used);
+  }
+  return true;
+}
+
+/**
+ * Read a job from the start of the bytes of a client
+ *
+ * Output:  size_t& used  - the length of the request in bytes
+ *
+ * Requests which are well formed but cannot run are answered with an error.
+ */
+template<typename T>
+typename JobServer<T>::Request JobServer<T>::readRequest(int client, const std::string& bytes, size_t& used) {
+
+  RequestReader reader(bytes);
+
+  uint32_t magic, elementSize, count, stages;
+  if (!reader.number(magic)) {
+    return Request::Incomplete;
+  }
+  if (magic != JOB_MAGIC) {
+    return Request::Malformed;
+  }
+  if (!reader.number(elementSize) || !reader.number(count) || !reader.number(stages)) {
+    return Request::Incomplete;
+  }
+  if (stages > MAX_STAGES) {
+    return Request::Malformed;
+  }
+
+  Job job;
+  job.client = client;
+  job.count = count;
+
+  for (uint32_t i = 0; i < stages; i++) {
+    std::string name;
+    if (!reader.string(name)) {
+      return reader.malformed ? Request::Malformed : Request::Incomplete;
+    }
+    job.pipeline.push_back(name);
+    job.key += name + '\n';
+  }
+
+  std::string sharedMemory;
+  if (!reader.string(sharedMemory)) {
+    return reader.malformed ? Request::Malformed : Request::Incomplete;
+  }
+  used = reader.position;
+
+  if (elementSize != sizeof(T)) {
+    respond(client, false, "The server runs elements of " + std::to_string(sizeof(T)) + " bytes, not "
+      + std::to_string(elementSize));
+    return Request::Complete;
+  }
+  for (std::string& name : job.pipeline) {
+    if (!isIdentifier(name)) {
+      respond(client, false, "'" + name + "' is not a kernel name");
+      return Request::Complete;
+    }
+  }
+
+  if (count > 0) {
+    int fd = shm_open(sharedMemory.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+      respond(client, false, "Unable to open shared memory '" + sharedMemory + "': " + strerror(errno));
+      return Request::Complete;
+    }
+
+    // Touching pages past the end of the object would kill the server (SIGBUS)
+    struct stat info;
+    if (fstat(fd, &info) < 0 || (size_t)info.st_size < count * sizeof(T)) {
+      close(fd);
+      respond(client, false, "The shared memory '" + sharedMemory + "' is smaller than "
+        + std::to_string(count) + " elements");
+      return Request::Complete;
+    }
+
+    void * payload = mmap(NULL, count * sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (payload == MAP_FAILED) {
+      respond(client, false, "Unable to map shared memory '" + sharedMemory + "': " + strerror(errno));
+      return Request::Complete;
+    }
+    job.payload = (T*)payload;
+  }
+
+  if (pending.empty()) {
+    firstPending = std::chrono::steady_clock::now();
+  }
+  pending.push_back(std::move(job));
+  return Request::Complete;
+}
+
+/**
+ * Run the waiting jobs, concatenating the jobs of one pipeline up to the
+ * maximum batch size
+ */
+template<typename T>
+void JobServer<T>::runBatches() {
+
+  std::vector<Job> jobs;
+  jobs.swap(pending);
+
+  // Keep the arrival order within a pipeline
+  std::stable_sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b) { return a.key < b.key; });
+
+  std::vector<Job> batch;
+  size_t batchSize = 0;
+
+  for (Job& job : jobs) {
+    bool fits = !batch.empty() && batch[0].key == job.key && batchSize + job.count <= maxBatchSize;
+    if (!batch.empty() && !fits) {
+      runBatch(batch);
+      batch.clear();
+      batchSize = 0;
+    }
+    batchSize += job.count;
+    batch.push_back(std::move(job));
+  }
+
+  if (!batch.empty()) {
+    runBatch(batch);
+  }
+}
+
+/**
+ * Run one pipeline over the concatenated payloads of its jobs
+ *
+ * Effect:  Every job gets its results in its shared memory and a reply
+ */
+template<typename T>
+void JobServer<T>::runBatch(std::vector<Job>& batch) {
+
+  size_t total = 0;
+  for (Job& job : batch) {
+    total += job.count;
+  }
+
+  cl_command_queue queue = framework->commandQueue;
+  size_t capacityA = std::max(total, (size_t)1) * sizeof(T);
+  size_t capacityB = capacityA;
+  cl_mem a = NULL;
+  cl_mem b = NULL;
+
+  bool success = true;
+  std::string message;
+
+  try {
+    a = acquireBuffer(capacityA);
+    b = acquireBuffer(capacityB);
+
+    size_t offset = 0;
+    for (Job& job : batch) {
+      if (job.count) {
+        status = clEnqueueWriteBuffer(queue, a, CL_FALSE, offset * sizeof(T), job.count * sizeof(T), job.payload
+          , 0, NULL, NULL);
+        checkError("clEnqueueWriteBuffer job");
+        framework->telemetry.count(Telemetry::BytesToDevice, job.count * sizeof(T));
+      }
+      offset += job.count;
+    }
+
+    // Elementwise kernels do not care where one job ends and the next begins
+    for (std::string& name : batch[0].pipeline) {
+      if (total == 0) {
+        break;
+      }
+
+      cl_kernel kernel = getKernel(name);
+      status = clSetKernelArg(kernel, 0, sizeof(cl_mem), &a);
+      checkError("clSetKernelArg job input");
+      status = clSetKernelArg(kernel, 1, sizeof(cl_mem), &b);
+      checkError("clSetKernelArg job output");
+      framework->telemetry.count(Telemetry::ArgumentSets, 2);
+
+      status = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &total, NULL, 0, NULL, NULL);
+      checkError("Running kernel", name);
+      framework->telemetry.count(Telemetry::Launches);
+
+      std::swap(a, b);
+      std::swap(capacityA, capacityB);
+    }
+
+    offset = 0;
+    for (Job& job : batch) {
+      if (job.count) {
+        status = clEnqueueReadBuffer(queue, a, CL_FALSE, offset * sizeof(T), job.count * sizeof(T), job.payload
+          , 0, NULL, NULL);
+        checkError("clEnqueueReadBuffer job");
+        framework->telemetry.count(Telemetry::BytesFromDevice, job.count * sizeof(T));
+      }
+      offset += job.count;
+    }
+
+    status = clFinish(queue);
+    checkError("clFinish");
+  }
+  catch (std::exception& e) {
+    // The error goes to the clients, the server keeps running
+    clFinish(queue);
+    success = false;
+    message = e.what();
+  }
+
+  if (a != NULL) {
+    bufferPool.emplace(capacityA, a);
+  }
+  if (b != NULL) {
+    bufferPool.emplace(capacityB, b);
+  }
+
+  for (Job& job : batch) {
+    unmap(job);
+    respond(job.client, success, message);
+  }
+
+  jobCount += batch.size();
+  batchCount++;
+}
+
+template<typename T>
+void JobServer<T>::respond(int client, bool success, std::string message) {
+  // A client which went away notices nothing, its next read fails. The
+  // socket does not block, a client which does not read its replies loses
+  // them instead of stopping the server.
+  sendNumber(client, success ? 0 : 1) && sendString(client, message.substr(0, MAX_STRING));
+}
+
+template<typename T>
+void JobServer<T>::unmap(Job& job) {
+  if (job.payload != NULL) {
+    munmap(job.payload, job.count * sizeof(T));
+    job.payload = NULL;
+  }
+}
+
+template<typename T>
+void JobServer<T>::disconnect(int client) {
+
+  close(client);
+  clients.erase(std::remove(clients.begin(), clients.end(), client), clients.end());
+  partial.erase(client);
+
+  // Its waiting jobs have nobody to reply to
+  for (Job& job : pending) {
+    if (job.client == client) {
+      unmap(job);
+    }
+  }
+  pending.erase(std::remove_if(pending.begin(), pending.end(), [client](const Job& job) {
+    return job.client == client;
+  }), pending.end());
+}
+
+/**
+ * An elementwise kernel, built on first use and kept
+ *
+ * Input:   std::string name  - the entry function, read from name.cl
+ */
+template<typename T>
+cl_kernel JobServer<T>::getKernel(std::string name) {
+
+  auto it = kernels.find(name);
+  if (it != kernels.end()) {
+    return it->second;
+  }
+
+  cl_program program = framework->getProgram(name + ".cl", "");
+  cl_kernel kernel = clCreateKernel(program, name.c_str(), &status);
+  checkError("clCreateKernel", name);
+
+  cl_uint numArgs;
+  status = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint), &numArgs, NULL);
+  checkError("clGetKernelInfo CL_KERNEL_NUM_ARGS");
+
+  if (numArgs != 2) {
+    clReleaseKernel(kernel);
+    raiseError("'" + name + "' takes " + std::to_string(numArgs) + " arguments, a job runs kernels taking "
+      "(input, output)");
+  }
+
+  kernels[name] = kernel;
+  return kernel;
+}
+
+/**
+ * A buffer from the pool, or a new one
+ *
+ * Input:   size_t& bytes  - the size needed, rounded up to the capacity of the
+ *                           buffer (a power of two, so sizes are reused)
+ */
+template<typename T>
+cl_mem JobServer<T>::acquireBuffer(size_t& bytes) {
+
+  size_t capacity = 1;
+  while (capacity < bytes) {
+    capacity *= 2;
+  }
+  bytes = capacity;
+
+  auto it = bufferPool.find(capacity);
+  if (it != bufferPool.end()) {
+    cl_mem buffer = it->second;
+    bufferPool.erase(it);
+    return buffer;
+  }
+
+  cl_mem buffer = clCreateBuffer(framework->context, CL_MEM_READ_WRITE, capacity, NULL, &status);
+  checkError("clCreateBuffer job");
+  framework->telemetry.count(Telemetry::BufferAllocations);
+  return buffer;
+}
+
+/******************************************************************************/
+//  CLIENT
+/******************************************************************************/
+template<typename T>
+JobClient<T>::JobClient(std::string socketPath) {
+
+  if (socketPath.size() >= sizeof(sockaddr_un().sun_path)) {
+    raiseError("The socket path '" + socketPath + "' is too long");
+  }
+
+  connection = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (connection < 0) {
+    raiseError("Unable to create a socket: " + std::string(strerror(errno)));
+  }
+
+#ifdef SO_NOSIGPIPE
+  int on = 1;
+  setsockopt(connection, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+  sockaddr_un address = socketAddress(socketPath);
+  if (connect(connection, (sockaddr*)&address, sizeof(address)) < 0) {
+    std::string reason = strerror(errno);
+    close(connection);
+    raiseError("Unable to connect to the job server at '" + socketPath + "': " + reason);
+  }
+}
+
+template<typename T>
+JobClient<T>::~JobClient() {
+  if (connection >= 0) {
+    close(connection);
+  }
+}
+
+/**
+ * Submit a job and wait for its result
+ *
+ * Input:   const std::vector<std::string>& pipeline  - the kernels, in order
+ *          const std::vector<T>& input               - the values of the first kernel
+ *
+ * Output:  std::vector<T>  - the output of the last kernel
+ */
+template<typename T>
+std::vector<T> JobClient<T>::run(const std::vector<std::string>& pipeline, const std::vector<T>& input) {
+
+  std::string name = "/easyopencl-" + std::to_string(getpid()) + "-" + std::to_string(sharedMemoryCounter++);
+  size_t bytes = input.size() * sizeof(T);
+  T * payload = NULL;
+
+  if (bytes) {
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+      raiseError("Unable to create shared memory '" + name + "': " + strerror(errno));
+    }
+    if (ftruncate(fd, bytes) < 0) {
+      std::string reason = strerror(errno);
+      close(fd);
+      shm_unlink(name.c_str());
+      raiseError("Unable to size shared memory '" + name + "': " + reason);
+    }
+
+    void * mapped = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+      shm_unlink(name.c_str());
+      raiseError("Unable to map shared memory '" + name + "': " + strerror(errno));
+    }
+    payload = (T*)mapped;
+    memcpy(payload, &input[0], bytes);
+  }
+
+  bool sent = sendNumber(connection, JOB_MAGIC) && sendNumber(connection, sizeof(T))
+    && sendNumber(connection, input.size()) && sendNumber(connection, pipeline.size());
+  for (const std::string& stage : pipeline) {
+    sent = sent && sendString(connection, stage);
+  }
+  sent = sent && sendString(connection, name);
+
+  uint32_t reply = 1;
+  std::string message;
+  bool answered = sent && receiveNumber(connection, reply) && receiveString(connection, message);
+
+  std::vector<T> output(input.size());
+  if (bytes) {
+    if (answered && reply == 0) {
+      memcpy(&output[0], payload, bytes);
+    }
+    munmap(payload, bytes);
+    shm_unlink(name.c_str());
+  }
+
+  if (!answered) {
+    raiseError("The job server went away");
+  }
+  if (reply != 0) {
+    raiseError("Job failed on the server: " + message);
+  }
+  return output;
+}
+
+template class JobServer<float>;
+template class JobServer<int>;
+template class JobServer<double>;
+
+template class JobClient<float>;
+template class JobClient<int>;
+template class JobClient<double>;
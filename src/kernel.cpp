@@ -1,65 +1,74 @@
 #include "kernel.h"
 #include "easyopencl.h"
+#include "halfconversion.h"
+#include "specialization.h"
 
 #include <iostream>
 #include <sstream>
+#include <cstring>
 #include <utility>
 #include <fstream>
+#include <type_traits>
+
+/*******************************************************/
+//  Conversion to and from the 16 bit storage formats
+//  Only float kernels have reduced precision storage, the
+//  other types are rejected before these are called.
+/*******************************************************/
+static void narrow(const float* input, uint16_t* output, size_t n, Storage storage) {
+  if (storage == Storage::Half) {
+    floatToHalf(input, output, n);
+  } else {
+    floatToBFloat16(input, output, n);
+  }
+}
+
+static void widen(const uint16_t* input, float* output, size_t n, Storage storage) {
+  if (storage == Storage::Half) {
+    halfToFloat(input, output, n);
+  } else {
+    bfloat16ToFloat(input, output, n);
+  }
+}
+
+template<typename U>
+static void narrow(const U*, uint16_t*, size_t, Storage) {}
+
+template<typename U>
+static void widen(const uint16_t*, U*, size_t, Storage) {}
 
 /**
  * Load the kernel from disk
  *
  * Input:   std::string filename
+ *          std::string entry     - the entry function, by default the filename
+ *                                  without its extension
+ *          std::string options   - build options, eg. the types of a generic kernel
  * Output:  void
  *
- * Effect:  * Reads the file specified by the input filename into a string
- *          * Create a cl_program object from the source and build it
+ * Effect:  * Let the framework read and build the program from the file
  *          * Create a kernel from the compiled code and store it
  */
 template<typename T>
  Kernel<T>::Kernel(std::string id_, cl_context& context_, cl_command_queue& commandQueue_
-                  , cl_device_id* devices, std::string filename, EasyOpenCL<T>* framework_ ) {
+                  , std::string filename, EasyOpenCL<T>* framework_
+                  , std::string entry, std::string options ) {
 
   //Assign the captured variables
   id = id_;
   context = context_;
   commandQueue = commandQueue_;
   framework = framework_;
+  debug = framework->info;
 
-  // Open the file
-  std::ifstream f(filename);
-  if (!f.good()) {
-    raiseError("Unable to open kernel file: " + filename);
-  }
-
-  // Store the file contents as a std::string using a std::stringstream
-  std::stringstream buffer;
-  buffer << f.rdbuf();
-  std::string fileContents = buffer.str();
-
-  // Convert it to a C-style string
-  const char *source = fileContents.c_str();
-  const size_t length = fileContents.length();
-
-  // Create a cl_program object from the source code string
-  cl_program program = clCreateProgramWithSource(context, 1, &source, &length, &status);
-  checkError("clCreateProgramWithSource");
-
-  // Build the program file into an object file
-  status = clBuildProgram(program, 1, devices, NULL, NULL, NULL);
-
-  // On failure, allocate a buffer, fill it with the error message and display it
-  if(status != CL_SUCCESS) {
-    char buffer[10240];
-    clGetProgramBuildInfo(program, devices[0], CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, NULL);
-    std::cerr << buffer << std::endl;
-  }
-  checkError("clBuildProgram");
+  // Read the file and build it into a cl_program object, shared with
+  // the other instances of the kernel
+  cl_program program = framework->getProgram(filename, options);
 
   // Create a kernel from the built program
   // The kernel name is the same as the filename, without the extension
   // This name should match the entry function in the file
-  std::string kernelName_file = filename.substr(0, filename.find('.'));
+  std::string kernelName_file = entry.empty() ? filename.substr(0, filename.find('.')) : entry;
 
   kernel = clCreateKernel(program, kernelName_file.c_str(), &status);
   if(status != CL_SUCCESS) {
@@ -70,9 +79,15 @@ template<typename T>
   }
   checkError("clCreateKernel");
 
-  // Clean up the object files of the program now we have obtained the kernel
-  status = clReleaseProgram(program);
-  checkError("clReleaseProgram");
+  // The signature does not change, ask for it once
+  status = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint), &numArgs, NULL);
+  checkError("clGetKernelInfo CL_KERNEL_NUM_ARGS");
+
+  genericKernel = kernel;
+  sourceFile = filename;
+  entryName = kernelName_file;
+  buildOptions = options;
+  specializeAfter = framework->specializeAfter;
 }
 
 /******************************************************************************/
@@ -98,22 +113,81 @@ void Kernel<T>::bindInput(uint argPos, std::vector<T> input) {
   // Getting the boundValues from the vector involves from C-style hacking
   // It passes a pointer to the first element in the vector - so this does assume
   // that all elements are sequentially aligned in memory
-  cl_mem inputBuffer = clCreateBuffer(context
-    , CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR
-    , input.size() * sizeof(T)
-    , (void*)&input[0]
-    , NULL);
+  cl_mem inputBuffer = uploadBuffer((void*)&input[0], input.size() * sizeof(T), argPos);
 
   status = clSetKernelArg(kernel
     , argPos
     , sizeof(cl_mem)
     , (void*)&inputBuffer );
 
-  checkError("clSetKernelArg input " + std::to_string(argPos));
+  checkError("clSetKernelArg input", argPos);
+  framework->telemetry.count(Telemetry::ArgumentSets);
 
   // Add the buffer to the map for later reference - retrieval and cleanup
   erase(argPos);
-  boundBuffers.emplace(argPos, BoundBuffer(inputBuffer, input.size()));
+  boundBuffers.emplace(argPos, BoundBuffer(inputBuffer, input.size(), sizeof(T)));
+  framework->reserveMemory(*this, true);
+}
+
+/**
+ * Add an input buffer stored in a 16 bit format
+ *
+ * Input:   int argPos              - the position of the argument
+ *          std::vector<T> input    - the values of the kernel input
+ *          Storage storage         - the format of the buffer on the device
+ *          bool convertOnDevice    - upload the floats and let the device
+ *                                    convert them, instead of the host
+ */
+template<typename T>
+void Kernel<T>::bindInput(uint argPos, std::vector<T> input, Storage storage, bool convertOnDevice) {
+
+  if (storage == Storage::Native) {
+    bindInput(argPos, std::move(input));
+    return;
+  }
+
+  if (std::is_same<T, float>::value == false) {
+    raiseError("Reduced precision storage is only available for float kernels");
+  }
+
+  vectorSize = input.size();
+
+  if(framework->getVectorSize() == -1) {
+    framework->setVectorSize(vectorSize);
+  }
+
+  cl_mem storageBuffer;
+
+  if (convertOnDevice) {
+
+    // Upload the floats as they are, the device narrows them
+    cl_mem floatBuffer = uploadBuffer((void*)&input[0], input.size() * sizeof(T), argPos);
+
+    storageBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, input.size() * sizeof(cl_half), NULL, &status);
+    checkError("clCreateBuffer input", argPos);
+    framework->telemetry.count(Telemetry::BufferAllocations);
+
+    framework->builtins.convert(floatBuffer, storageBuffer, input.size(), storage);
+
+    status = clReleaseMemObject(floatBuffer);
+    checkError("clReleaseMemObject conversion input");
+
+  } else {
+
+    // Narrow on the host, only half of the bytes are transferred
+    std::vector<uint16_t> narrowed(input.size());
+    narrow(&input[0], &narrowed[0], input.size(), storage);
+
+    storageBuffer = uploadBuffer((void*)&narrowed[0], narrowed.size() * sizeof(cl_half), argPos);
+  }
+
+  status = clSetKernelArg(kernel, argPos, sizeof(cl_mem), (void*)&storageBuffer);
+  checkError("clSetKernelArg input", argPos);
+  framework->telemetry.count(Telemetry::ArgumentSets);
+
+  erase(argPos);
+  boundBuffers.emplace(argPos, BoundBuffer(storageBuffer, input.size(), sizeof(cl_half), storage));
+  framework->reserveMemory(*this, true);
 }
 
 /**
@@ -125,17 +199,28 @@ void Kernel<T>::bindInput(uint argPos, std::vector<T> input) {
 /*
   Buffer length check priority:
   1. passed as an argument
-  2. the value of the kernel
-  3. the value of the framework
+  2. the length fixed for the argument (eg. y of a sparse matrix-vector product)
+  3. the value of the kernel
+  4. the value of the framework
  */
 template<typename T>
 void Kernel<T>::bindOutput(uint argPos) {
+  bindOutput(argPos, Storage::Native);
+}
+
+template<typename T>
+void Kernel<T>::bindOutput(uint argPos, Storage storage) {
 
   // The program needs to know the length of the buffer - therefore, first pass
   // an input buffer so the length can be determined
-  uint bufferSize;
+  uint bufferSize = 0;
 
-  if (vectorSize != -1)
+  if (outputLengths.count(argPos))
+  {
+    //fixed for the argument
+    bufferSize = outputLengths.at(argPos);
+  }
+  else if (vectorSize != -1)
   {
     //from the kernel
     bufferSize = vectorSize;
@@ -150,20 +235,177 @@ void Kernel<T>::bindOutput(uint argPos) {
     raiseError("Unable to determine output buffer size.");
   }
 
-  bindOutput(argPos, bufferSize);
+  bindOutput(argPos, bufferSize, storage);
 }
 
 template<typename T>
-void Kernel<T>::bindOutput(uint argPos, uint bufferSize) {
+void Kernel<T>::bindOutput(uint argPos, uint bufferSize, Storage storage) {
+
+  if (storage != Storage::Native && std::is_same<T, float>::value == false) {
+    raiseError("Reduced precision storage is only available for float kernels");
+  }
+
+  size_t elementSize = (storage == Storage::Native) ? sizeof(T) : sizeof(cl_half);
 
   // Create and append the actual output buffer
-  cl_mem outputBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, bufferSize * sizeof(T), NULL, NULL);
+  cl_mem outputBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, bufferSize * elementSize, NULL, &status);
+  checkError("clCreateBuffer output", argPos);
+  framework->telemetry.count(Telemetry::BufferAllocations);
+
   status = clSetKernelArg(kernel, argPos, sizeof(cl_mem), (void *)&outputBuffer);
-  checkError("clSetKernelArg outputBuffer " + std::to_string(argPos));
+  checkError("clSetKernelArg outputBuffer", argPos);
+  framework->telemetry.count(Telemetry::ArgumentSets);
 
   // Add the buffer to the map for later reference - retrieval and cleanup
   erase(argPos);
-  boundBuffers.emplace(argPos, BoundBuffer(outputBuffer, bufferSize));
+  boundBuffers.emplace(argPos, BoundBuffer(outputBuffer, bufferSize, elementSize, storage));
+  boundBuffers.at(argPos).markOutput();
+  framework->reserveMemory(*this, true);
+}
+
+/**
+ * Add an input array of another element type than the kernel
+ *
+ * Input:   uint argPos         - the position of the argument
+ *          const void* data    - the elements
+ *          size_t count        - the number of elements
+ *          size_t elementSize  - the size of an element in bytes
+ *          bool integer        - the elements are cl_int (keys of a histogram)
+ *          bool otherType      - the elements are not of the type of the kernel
+ *
+ * Effect:  Unlike bindInput, the length of the array does not determine the
+ *          range of the kernel (eg. the row pointers of a sparse matrix)
+ */
+template<typename T>
+void Kernel<T>::bindArray(uint argPos, const void* data, size_t count, size_t elementSize, bool integer
+                         , bool otherType) {
+
+  // OpenCL does not allow empty buffers
+  char empty = 0;
+  cl_mem arrayBuffer = uploadBuffer(count ? data : &empty, count ? count * elementSize : 1, argPos);
+
+  status = clSetKernelArg(kernel, argPos, sizeof(cl_mem), (void*)&arrayBuffer);
+  checkError("clSetKernelArg array", argPos);
+  framework->telemetry.count(Telemetry::ArgumentSets);
+
+  erase(argPos);
+  boundBuffers.emplace(argPos, BoundBuffer(arrayBuffer, count, elementSize));
+  if (integer) {
+    boundBuffers.at(argPos).markInt();
+  }
+  if (otherType) {
+    boundBuffers.at(argPos).markOtherType();
+  }
+  framework->reserveMemory(*this, true);
+}
+
+/**
+ * Add an array of structs as one array per field
+ *
+ * Input:   uint argPos         - the position of the first field
+ *          const void* data    - the structs
+ *          size_t count        - the number of structs
+ *          size_t stride       - the size of a struct in bytes
+ *          std::vector<StructField> fields - the fields, bound from argPos on
+ *
+ * Effect:  The structs are uploaded once and every field is copied into its
+ *          own buffer by the device, so the kernel reads them coalesced.
+ *          Like bindInput, the number of structs sets the range.
+ */
+template<typename T>
+void Kernel<T>::bindStructs(uint argPos, const void* data, size_t count, size_t stride
+                           , std::vector<StructField> fields) {
+
+  if (count == 0) {
+    raiseError("Unable to bind an empty array of structs to " + std::to_string(argPos));
+  }
+
+  vectorSize = count;
+
+  if(framework->getVectorSize() == -1) {
+    framework->setVectorSize(vectorSize);
+  }
+
+  cl_mem structBuffer = uploadBuffer(data, count * stride, argPos);
+
+  for (uint i = 0; i < fields.size(); i++) {
+    cl_mem fieldBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, count * fields[i].size, NULL, &status);
+    checkError("clCreateBuffer field", argPos + i);
+    framework->telemetry.count(Telemetry::BufferAllocations);
+
+    framework->builtins.splitField(structBuffer, fieldBuffer, count, stride, fields[i].offset, fields[i].size);
+
+    status = clSetKernelArg(kernel, argPos + i, sizeof(cl_mem), (void*)&fieldBuffer);
+    checkError("clSetKernelArg field", argPos + i);
+    framework->telemetry.count(Telemetry::ArgumentSets);
+
+    erase(argPos + i);
+    boundBuffers.emplace(argPos + i, BoundBuffer(fieldBuffer, count, fields[i].size));
+    boundBuffers.at(argPos + i).markField();
+  }
+
+  // Released once the transpositions are done
+  status = clReleaseMemObject(structBuffer);
+  checkError("clReleaseMemObject struct input");
+
+  framework->reserveMemory(*this, true);
+}
+
+/**
+ * Add one output buffer per field of 'count' structs, from argPos on
+ */
+template<typename T>
+void Kernel<T>::bindStructOutput(uint argPos, uint count, std::vector<StructField> fields) {
+
+  if (count == 0) {
+    raiseError("Unable to bind an empty array of structs to " + std::to_string(argPos));
+  }
+
+  for (uint i = 0; i < fields.size(); i++) {
+    cl_mem fieldBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, count * fields[i].size, NULL, &status);
+    checkError("clCreateBuffer field", argPos + i);
+    framework->telemetry.count(Telemetry::BufferAllocations);
+
+    status = clSetKernelArg(kernel, argPos + i, sizeof(cl_mem), (void*)&fieldBuffer);
+    checkError("clSetKernelArg field", argPos + i);
+    framework->telemetry.count(Telemetry::ArgumentSets);
+
+    erase(argPos + i);
+    boundBuffers.emplace(argPos + i, BoundBuffer(fieldBuffer, count, fields[i].size));
+    boundBuffers.at(argPos + i).markOutput();
+    boundBuffers.at(argPos + i).markField();
+  }
+
+  framework->reserveMemory(*this, true);
+}
+
+/**
+ * Copy host memory into a new device buffer
+ *
+ * Input:   const void* data  - the values to upload
+ *          size_t bytes      - the size of the buffer
+ *          uint argPos       - the argument the buffer is for, for errors
+ *
+ * Output:  cl_mem            - the buffer, owned by the caller
+ *
+ * An explicit write instead of CL_MEM_COPY_HOST_PTR, so the transfer has an
+ * event which can be profiled.
+ */
+template<typename T>
+cl_mem Kernel<T>::uploadBuffer(const void* data, size_t bytes, uint argPos) {
+
+  cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, &status);
+  checkError("clCreateBuffer input", argPos);
+  framework->telemetry.count(Telemetry::BufferAllocations);
+
+  cl_event event = NULL;
+  status = clEnqueueWriteBuffer(commandQueue, buffer, CL_TRUE, 0, bytes, data
+    , 0, NULL, framework->profilingEvent(event));
+  checkError("clEnqueueWriteBuffer input", argPos);
+  framework->telemetry.count(Telemetry::BytesToDevice, bytes);
+
+  recordTransfer(event, true);
+  return buffer;
 }
 
 template<typename T>
@@ -172,38 +414,318 @@ void Kernel<T>::bindPromise(Kernel<T>& sourceKernel, uint sourceArgPos, uint arg
   boundPromises.emplace(argPos, BoundPromise<T>(&sourceKernel, sourceArgPos, argPos));
 }
 
+/**
+ * Bind part of the buffer of another kernel, without copying it
+ *
+ * Input:   uint argPos             - the position of the argument
+ *          Kernel<T>& sourceKernel - the kernel the buffer is bound to
+ *          uint sourceArgPos       - the position of the buffer in the source
+ *          uint offset             - the first element of the slice
+ *          uint length             - the number of elements in the slice
+ *
+ * Effect:  * Creates a sub-buffer of the source buffer, writes to the slice
+ *            end up in the source buffer
+ *          * The source kernel becomes a dependency, like with a promise
+ *          * The slice can be the source of a link() itself
+ *
+ * The offset in bytes has to be a multiple of CL_DEVICE_MEM_BASE_ADDR_ALIGN.
+ */
+template<typename T>
+void Kernel<T>::bindSlice(uint argPos, Kernel<T>& sourceKernel, uint sourceArgPos, uint offset, uint length) {
+
+  BoundBuffer& source = sourceKernel.resolveBuffer(sourceArgPos);
+
+  if (length == 0 || offset + length > source.getSize()) {
+    raiseError("Slice [" + std::to_string(offset) + ", " + std::to_string(offset + length)
+      + ") does not fit in the buffer of " + std::to_string(source.getSize()) + " elements");
+  }
+
+  // Sub-buffers cannot be nested, always slice the original buffer
+  cl_mem parent = source.isView() ? source.getParent() : (cl_mem)source;
+  uint parentOffset = source.getOffset() + offset;
+
+  cl_uint alignBits;
+  status = clGetDeviceInfo(framework->devices[0], CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &alignBits, NULL);
+  checkError("clGetDeviceInfo CL_DEVICE_MEM_BASE_ADDR_ALIGN");
+
+  cl_buffer_region region;
+  region.origin = parentOffset * source.getElementSize();
+  region.size = length * source.getElementSize();
+
+  if (region.origin % (alignBits / 8) != 0) {
+    raiseError("Slice offset of " + std::to_string(region.origin) + " bytes is not a multiple of the "
+      + std::to_string(alignBits / 8) + " bytes alignment of the device");
+  }
+
+  cl_mem slice = clCreateSubBuffer(parent, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &status);
+  checkError("clCreateSubBuffer", argPos);
+
+  status = clSetKernelArg(kernel, argPos, sizeof(cl_mem), (void*)&slice);
+  checkError("clSetKernelArg slice", argPos);
+  framework->telemetry.count(Telemetry::ArgumentSets);
+
+  // The slice determines the range of the kernel, like an input does
+  vectorSize = length;
+
+  erase(argPos);
+  BoundPromise<T> promise(&sourceKernel, sourceArgPos, argPos);
+  promise.view.reset(new BoundBuffer(slice, length, source.getElementSize(), source.getStorage()));
+  promise.view->setView(parent, parentOffset);
+  if (source.holdsInt()) {
+    promise.view->markInt();
+  }
+  if (source.holdsOtherType()) {
+    promise.view->markOtherType();
+  }
+  if (source.isField()) {
+    promise.view->markField();
+  }
+  boundPromises.emplace(argPos, std::move(promise));
+}
+
+/**
+ * Pass shared virtual memory to the kernel
+ *
+ * Input:   uint argPos   - the position of the argument
+ *          void* pointer - into memory of framework.svmAllocator<U>()
+ *          uint count    - the number of elements, sets the range like an input (0 keeps it)
+ *
+ * Effect:  The kernel and the host use the same memory, nothing is copied. The
+ *          kernel may follow pointers into any other shared allocation, and
+ *          evaluate() waits for it so the host can read the results directly.
+ */
+template<typename T>
+void Kernel<T>::bindSVM(uint argPos, void* pointer, uint count) {
+
+#ifdef CL_VERSION_2_0
+  status = clSetKernelArgSVMPointer(kernel, argPos, pointer);
+  checkError("clSetKernelArgSVMPointer", argPos);
+  framework->telemetry.count(Telemetry::ArgumentSets);
+
+  if (count) {
+    vectorSize = count;
+  }
+
+  erase(argPos);
+  boundSVM.emplace(argPos, pointer);
+#else
+  raiseError("Shared virtual memory needs OpenCL 2.0");
+#endif
+}
+
 
 /******************************************************************************/
 //  MANAGING THE BOUNDVALUE MAPS
 /******************************************************************************/
 template<typename T>
 void Kernel<T>::erase(uint argPos) {
+
+  // Release the memory objects owned by the old binding
+  auto itBuffer = boundBuffers.find(argPos);
+  if (itBuffer != boundBuffers.end()) {
+    if (itBuffer->second.isSpilled()) {
+      framework->spilledBuffers--;
+    } else {
+      status = clReleaseMemObject(itBuffer->second);
+      checkError("clReleaseMemObject rebinding", argPos);
+    }
+  }
+
+  auto itPromise = boundPromises.find(argPos);
+  if (itPromise != boundPromises.end() && itPromise->second.view) {
+    status = clReleaseMemObject(*itPromise->second.view);
+    checkError("clReleaseMemObject slice", argPos);
+  }
+
   boundScalars.erase(argPos);
   boundBuffers.erase(argPos);
   boundPromises.erase(argPos);
+  boundSVM.erase(argPos);
 }
 
-/*******************************************************/
-//  RUNNING A KERNEL
-/*******************************************************/
 template<typename T>
-void Kernel<T>::evaluate() {
+bool Kernel<T>::isSlice(uint argPos) {
+  auto it = boundPromises.find(argPos);
+  return it != boundPromises.end() && it->second.view;
+}
+
+/**
+ * Find the kernel which owns the buffer behind an argument position
+ *
+ * Input:   uint argPos       - the position of the argument
+ *
+ * Output:  Kernel<T>*& owner - this kernel or, for a promise, the source kernel
+ *          uint& ownerPos    - the position of the buffer in the owner
+ */
+template<typename T>
+void Kernel<T>::resolveOwner(uint argPos, Kernel<T>*& owner, uint& ownerPos) {
 
-  if(debug) {
-    std::cout << "Attempting to execute '" << id << "'." << std::endl;
+  // Check whether the argument was actually part of the kernel
+  auto itBuffer = boundBuffers.find(argPos);
+  auto itPromise = boundPromises.find(argPos);
+
+  if(itBuffer == boundBuffers.end() && itPromise == boundPromises.end()) {
+    raiseError("The buffer at position " + std::to_string(argPos) + " could not be retrieved");
   }
 
-  // Check whether the buffers specified have all been specified
-  cl_uint kernelNumArgs;
-  status = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint), &kernelNumArgs, NULL);
+  if(itBuffer != boundBuffers.end() || itPromise->second.view) {
+    // The found buffer is an actual one, or a slice owned by this kernel
+    owner = this;
+    ownerPos = argPos;
+  } else {
+    // Follow the promise, the source can hold a slice itself
+    itPromise->second.sourceKernel->resolveOwner(itPromise->second.sourceArgPos, owner, ownerPos);
+  }
+}
 
+template<typename T>
+BoundBuffer& Kernel<T>::resolveBuffer(uint argPos, bool restoreSpilled) {
+  Kernel<T> * owner;
+  uint ownerPos;
+  resolveOwner(argPos, owner, ownerPos);
+
+  auto itBuffer = owner->boundBuffers.find(ownerPos);
+  if (itBuffer != owner->boundBuffers.end()) {
+    // Whoever asks for a spilled buffer gets it back on the device
+    if (itBuffer->second.isSpilled() && restoreSpilled) {
+      owner->restore(ownerPos);
+    }
+    return itBuffer->second;
+  }
+  return *owner->boundPromises.at(ownerPos).view;
+}
 
-  uint totalBoundArguments = boundScalars.size() + boundBuffers.size() + boundPromises.size();
+/******************************************************************************/
+//  SPILLING BUFFERS TO THE HOST
+/******************************************************************************/
+/**
+ * Move a buffer to host memory, releasing its device memory
+ *
+ * Input:   uint argPos - a buffer owned by this kernel, not shared with others
+ */
+template<typename T>
+void Kernel<T>::spill(uint argPos) {
+
+  BoundBuffer& buffer = boundBuffers.at(argPos);
+  std::vector<char>& contents = buffer.getHostCopy();
+  contents.resize(buffer.getBytes());
+
+  cl_event event = NULL;
+  status = clEnqueueReadBuffer(commandQueue, buffer, CL_TRUE, 0, contents.size(), &contents[0]
+    , 0, NULL, framework->profilingEvent(event));
+  checkError("clEnqueueReadBuffer spilling", argPos);
+  framework->telemetry.count(Telemetry::BytesFromDevice, contents.size());
+  recordTransfer(event);
+
+  status = clReleaseMemObject(buffer);
+  checkError("clReleaseMemObject spilling", argPos);
+
+  buffer.reset(NULL, buffer.getSize());
+  buffer.setSpilled(true);
+  framework->spilledBuffers++;
+  framework->telemetry.count(Telemetry::BuffersSpilled);
+}
 
-  if(kernelNumArgs != totalBoundArguments) {
-    raiseError("You have only specified " + std::to_string(totalBoundArguments) + "/" + std::to_string(kernelNumArgs) + " arguments for kernel '" + id + "'. (TODO, which ones are lacking?");
+/**
+ * Move a spilled buffer back to the device
+ *
+ * Input:   uint argPos - a spilled buffer owned by this kernel
+ *
+ * Effect:  The buffer gets a new memory object, bound to this kernel again.
+ *          Kernels reading it through a promise pick it up when they launch.
+ */
+template<typename T>
+void Kernel<T>::restore(uint argPos) {
+
+  BoundBuffer& buffer = boundBuffers.at(argPos);
+  std::vector<char>& contents = buffer.getHostCopy();
+
+  buffer.reset(uploadBuffer(&contents[0], contents.size(), argPos), buffer.getSize());
+  buffer.setSpilled(false);
+  framework->spilledBuffers--;
+  framework->telemetry.count(Telemetry::BuffersRestored);
+
+  status = clSetKernelArg(kernel, argPos, sizeof(cl_mem), (void*)&buffer.getMemObject());
+  checkError("clSetKernelArg restored", argPos);
+  framework->telemetry.count(Telemetry::ArgumentSets);
+}
+
+/**
+ * Make sure the buffer behind an argument is on the device and bound
+ *
+ * Input:   uint argPos - a buffer or promise of this kernel
+ *
+ * Output:  BoundBuffer& - the buffer, owned by this kernel or a source
+ */
+template<typename T>
+BoundBuffer& Kernel<T>::prepareBuffer(uint argPos) {
+
+  Kernel<T> * owner;
+  uint ownerPos;
+  resolveOwner(argPos, owner, ownerPos);
+
+  auto itBuffer = owner->boundBuffers.find(ownerPos);
+  if (itBuffer == owner->boundBuffers.end()) {
+    return *owner->boundPromises.at(ownerPos).view;
   }
 
+  if (itBuffer->second.isSpilled()) {
+    owner->restore(ownerPos);
+    if (owner != this) {
+      setBufferArgument(argPos);
+    }
+  }
+  return itBuffer->second;
+}
+
+template<typename T>
+size_t Kernel<T>::getDeviceMemory() {
+
+  size_t bytes = 0;
+  for (auto& kv : boundBuffers) {
+    if (!kv.second.isSpilled()) {
+      bytes += kv.second.getBytes();
+    }
+  }
+  return bytes;
+}
+
+/**
+ * The order in which evaluate() runs this kernel and its dependencies
+ *
+ * Input:   std::vector<Kernel<T>*>& order  - appended to, dependencies first
+ *          std::set<Kernel<T>*>& visited   - the kernels already in the order
+ *
+ * Mirrors evaluate(): the promises are resolved in order of their argument
+ * position, depth first, and every kernel only runs once.
+ */
+template<typename T>
+void Kernel<T>::collectExecutionOrder(std::vector<Kernel<T>*>& order, std::set<Kernel<T>*>& visited) {
+
+  if (visited.count(this)) {
+    return;
+  }
+  visited.insert(this);
+
+  for (auto& kv : boundPromises) {
+    kv.second.sourceKernel->collectExecutionOrder(order, visited);
+  }
+
+  order.push_back(this);
+}
+
+/*******************************************************/
+//  RUNNING A KERNEL
+/*******************************************************/
+template<typename T>
+void Kernel<T>::evaluate() {
+
+  ScopedTimer timer(framework->telemetry, Telemetry::Evaluate);
+
+  EASYOPENCL_LOG(LOG_DEBUG, debug, "Attempting to execute '" << id << "'.");
+
+  checkArguments();
+
   //Check whether there are dependencies
   if(boundPromises.size()) {
     // Dependencies exist, find them and resolve them by executing them
@@ -212,46 +734,77 @@ void Kernel<T>::evaluate() {
         //uint argPos = kv.first;
         BoundPromise<T>& promise = kv.second;
         Kernel<T> * sourceKernel = promise.sourceKernel;
-        std::string sourceId = sourceKernel->getId();
+        const std::string& sourceId = sourceKernel->getId();
 
-        std::cout << "Found dependency\t" <<
-        sourceId << "(" << promise.sourceArgPos << ") -> " <<
-        id << "(" << promise.targetArgPos << ")" << std::endl;
+        EASYOPENCL_LOG(LOG_DEBUG, debug, "Found dependency\t" <<
+          sourceId << "(" << promise.sourceArgPos << ") -> " <<
+          id << "(" << promise.targetArgPos << ")");
 
         if(sourceKernel->getExecutionCount() == 0) {
 
-          if(debug) {
-            std::cout << sourceId << " has not been executed yet. Attempting to run!" << std::endl;
-          }
+          EASYOPENCL_LOG(LOG_DEBUG, debug, sourceId << " has not been executed yet. Attempting to run!");
 
           //Run the kernel (this can trigger more dependencies)
           sourceKernel->evaluate();
 
-          BoundBuffer& buf = sourceKernel->boundBuffers.find(promise.sourceArgPos)->second;
-          cl_mem& memObject = buf.getMemObject();
-
-          //Set the kernel arguments of the current kernel
-          status = clSetKernelArg(kernel      // change the current kernel
-                    , promise.targetArgPos    // bind to the port that depends
-                    , sizeof(cl_mem)
-                    , (void*)&memObject);  // the cl_mem object from the output
-
-          checkError("Added output buffer already present on GPU to dependent kernel '" + id + "'");
-
         } else {
-          if(debug) {
-            std::cout << sourceId << " has been executed already!" << std::endl;
-          }
+          EASYOPENCL_LOG(LOG_DEBUG, debug, sourceId << " has been executed already!");
         }
+
+        // Bind the output of the source every time, the source buffer may have
+        // been replaced since the last evaluation (eg. by a compaction)
+        setBufferArgument(kv.first);
       }
   }
   else {
-    if(debug) {
-      std::cout << "No kernel dependencies found." << std::endl;
-    }
+    EASYOPENCL_LOG(LOG_DEBUG, debug, "No kernel dependencies found.");
   }
 
+  launch();
 
+  EASYOPENCL_LOG(LOG_DEBUG, debug, "Executed '" << id << "'.");
+}
+
+/**
+ * Check whether the buffers specified have all been specified
+ */
+template<typename T>
+void Kernel<T>::checkArguments() {
+
+  uint totalBoundArguments = boundScalars.size() + boundBuffers.size() + boundPromises.size()
+                             + boundSVM.size();
+
+  if(numArgs != totalBoundArguments) {
+    raiseError("You have only specified " + std::to_string(totalBoundArguments) + "/" + std::to_string(numArgs) + " arguments for kernel '" + id + "'. (TODO, which ones are lacking?");
+  }
+}
+
+/**
+ * Pass the memory object currently behind an argument to the kernel
+ *
+ * Input:   uint argPos - a buffer, a slice or a promise
+ */
+template<typename T>
+void Kernel<T>::setBufferArgument(uint argPos) {
+
+  BoundBuffer& buf = resolveBuffer(argPos);
+  cl_mem& memObject = buf.getMemObject();
+
+  //Set the kernel arguments of the current kernel
+  status = clSetKernelArg(kernel      // change the current kernel
+            , argPos                  // bind to the port that depends
+            , sizeof(cl_mem)
+            , (void*)&memObject);  // the cl_mem object from the output
+
+  checkError("Added output buffer already present on GPU to dependent kernel", id);
+  framework->telemetry.count(Telemetry::ArgumentSets);
+}
+
+/**
+ * Enqueue the kernel with the arguments as they are set, without waiting
+ */
+template<typename T>
+void Kernel<T>::launch() {
 
   /*
   // Get the kernel max work group size
@@ -273,25 +826,84 @@ void Kernel<T>::evaluate() {
     vectorSize = framework->getVectorSize();
   }
 
-  size_t global_work_size[] = { vectorSize };
-  size_t local_work_size[] = { vectorSize };
+  if (specializeAfter && !boundScalars.empty()) {
+    specialize();
+  }
+
+  // setWorkSize() takes precedence over the length of the buffers
+  bool explicitRange = globalWorkSize[0] != 0;
+  cl_uint dimensions = explicitRange ? workDimensions : 1;
+  size_t global_work_size[] = { explicitRange ? globalWorkSize[0] : vectorSize, globalWorkSize[1] };
+  size_t local_work_size[] = { explicitRange ? localWorkSize[0] : vectorSize, localWorkSize[1] };
+
+  // Only the last launch is kept for profiling
+  if (launchEvent != NULL) {
+    status = clReleaseEvent(launchEvent);
+    checkError("clReleaseEvent");
+    launchEvent = NULL;
+  }
+
+  // Nothing to do for an empty range (eg. after a compaction kept nothing),
+  // OpenCL does not allow launching it
+  if (global_work_size[0] == 0 || global_work_size[1] == 0) {
+    EASYOPENCL_LOG(LOG_DEBUG, debug, "Skipped '" << id << "', its range is empty.");
+    executionCounter++;
+    lastTransferTime = uploadTime;
+    uploadTime = 0;
+    return;
+  }
+
+  // Bring back what this launch reads, and make room for it
+  framework->reserveMemory(*this, false);
+
+  // Shared memory may hold pointers to other allocations, let the kernel
+  // reach all of them and take them from the host while it runs
+  if (!boundSVM.empty()) {
+    useSharedMemory();
+  }
 
   // Invoke the actual kernel execution
   status = clEnqueueNDRangeKernel(  commandQueue
           , kernel
-          , 1               // The work dimension (1, 2 or 3)
+          , dimensions      // The work dimension (1, 2 or 3)
           , NULL            // global_work_offset (must be NULL)
           , global_work_size
-          , local_work_size
+          , local_work_size[0] ? local_work_size : NULL  // NULL: chosen by the runtime
           , 0               // amount of events needing completion before this
           , NULL            // event wait list
-          , NULL );         // pointer to a event object for this execution
+          , framework->profilingEvent(launchEvent) );  // pointer to a event object for this execution
 
-  checkError("Running kernel " + id);
+  checkError("Running kernel", id);
+  framework->telemetry.count(Telemetry::Launches);
 
   executionCounter++;
 
-  std::cout << "Executed '" << id << "'." << std::endl;
+  // The uploads since the last launch were for this one
+  lastTransferTime = uploadTime;
+  uploadTime = 0;
+
+  // The host owns the memory again once the kernel finished
+  if (!boundSVM.empty()) {
+    framework->svm.acquire();
+  }
+}
+
+template<typename T>
+void Kernel<T>::useSharedMemory() {
+
+#ifdef CL_VERSION_2_0
+  SharedMemory& svm = framework->svm;
+
+  if (svmGeneration != svm.getGeneration()) {
+    std::vector<void*> pointers = svm.getPointers();
+    status = clSetKernelExecInfo(kernel, CL_KERNEL_EXEC_INFO_SVM_PTRS, pointers.size() * sizeof(void*)
+      , pointers.empty() ? NULL : &pointers[0]);
+    checkError("clSetKernelExecInfo CL_KERNEL_EXEC_INFO_SVM_PTRS");
+    svmGeneration = svm.getGeneration();
+  }
+
+  svm.release();
+#endif
 }
 
 /*******************************************************/
@@ -307,31 +919,33 @@ void Kernel<T>::evaluate() {
 template<typename T>
 std::vector<T> Kernel<T>::getBuffer(uint argPos) {
 
-  // Check whether the argument was actually part of the kernel
-  auto itBuffer = boundBuffers.find(argPos);
-  auto itPromise = boundPromises.find(argPos);
+  ScopedTimer timer(framework->telemetry, Telemetry::GetBuffer);
 
-  if(itBuffer == boundBuffers.end() && itPromise == boundPromises.end()) {
-    raiseError("The buffer at position " + std::to_string(argPos) + " could not be retrieved");
+  BoundBuffer& buffer = resolveBuffer(argPos);
+  uint size = buffer.getSize();
+  cl_mem bufferHandle = buffer;
+
+  if (size == 0) {
+    return std::vector<T>();
   }
 
-  uint size;
-  cl_mem bufferHandle;
+  if (buffer.getStorage() != Storage::Native) {
+    return getReducedBuffer(buffer);
+  }
 
-  if(itBuffer != boundBuffers.end()) {
-    // The found buffer is an actual one
-    size = itBuffer->second.getSize();
-    bufferHandle = itBuffer->second;
+  if (buffer.isField()) {
+    raiseError("Argument " + std::to_string(argPos) + " is a field of an array of structs, read it with getStructs");
+  }
 
-  } else {
-    uint pos = itPromise->second.sourceArgPos;
-    bufferHandle = itPromise->second.sourceKernel->boundBuffers.at(pos);
-    size = itPromise->second.sourceKernel->boundBuffers.at(pos).getSize();
+  if (buffer.holdsOtherType() || buffer.getElementSize() != sizeof(T)) {
+    raiseError("Argument " + std::to_string(argPos) + " holds elements of " + std::to_string(buffer.getElementSize())
+      + " bytes of another type than the kernel, read it with getArray");
   }
 
   T * hostBuffer = new T[size];
 
   // Read the values from the OpenCL device into the buffer
+  cl_event event = NULL;
 
   status = clEnqueueReadBuffer( commandQueue
     , bufferHandle
@@ -341,13 +955,15 @@ std::vector<T> Kernel<T>::getBuffer(uint argPos) {
     , hostBuffer
     , 0
     , NULL
-    , NULL );
+    , framework->profilingEvent(event) );
 
   //Clean up the buffer and raise an error if something went wrong
   if (status != CL_SUCCESS) {
     delete hostBuffer;
     raiseError("clEnqueueReadBuffer\t" + getErrorString(status));
   }
+  framework->telemetry.count(Telemetry::BytesFromDevice, size * sizeof(T));
+  recordTransfer(event);
 
   // Element by element - copy the boundValues into the vector
   std::vector<T> hostVector {};
@@ -362,6 +978,317 @@ std::vector<T> Kernel<T>::getBuffer(uint argPos) {
   return hostVector;
 }
 
+/**
+ * Read an array of another element type than the kernel
+ *
+ * Input:   uint argPos         - the position of the argument
+ *          size_t count        - the number of elements
+ *          size_t elementSize  - the size of an element in bytes
+ *
+ * Output:  void* data          - the elements
+ */
+template<typename T>
+void Kernel<T>::getArray(uint argPos, void* data, size_t count, size_t elementSize) {
+
+  ScopedTimer timer(framework->telemetry, Telemetry::GetBuffer);
+
+  BoundBuffer& buffer = resolveBuffer(argPos);
+  if (buffer.getStorage() != Storage::Native || buffer.getElementSize() != elementSize) {
+    raiseError("Argument " + std::to_string(argPos) + " does not hold elements of " + std::to_string(elementSize)
+      + " bytes");
+  }
+
+  if (count == 0) {
+    return;
+  }
+
+  cl_event event = NULL;
+  status = clEnqueueReadBuffer(commandQueue, buffer, CL_TRUE, 0, count * elementSize, data
+    , 0, NULL, framework->profilingEvent(event));
+  checkError("clEnqueueReadBuffer array", argPos);
+  framework->telemetry.count(Telemetry::BytesFromDevice, count * elementSize);
+  recordTransfer(event);
+}
+
+/**
+ * Read a 16 bit buffer and widen it to float on the host
+ */
+template<typename T>
+std::vector<T> Kernel<T>::getReducedBuffer(BoundBuffer& buffer) {
+
+  std::vector<uint16_t> narrowed(buffer.getSize());
+  cl_event event = NULL;
+
+  status = clEnqueueReadBuffer( commandQueue
+    , buffer
+    , CL_TRUE
+    , 0
+    , narrowed.size() * sizeof(cl_half)
+    , &narrowed[0]
+    , 0
+    , NULL
+    , framework->profilingEvent(event) );
+  checkError("clEnqueueReadBuffer");
+  framework->telemetry.count(Telemetry::BytesFromDevice, narrowed.size() * sizeof(cl_half));
+  recordTransfer(event);
+
+  std::vector<T> hostVector(narrowed.size());
+  widen(&narrowed[0], &hostVector[0], narrowed.size(), buffer.getStorage());
+  return hostVector;
+}
+
+/**
+ * Read field arrays back as an array of structs
+ *
+ * Input:   uint argPos         - the position of the first field
+ *          size_t count        - the number of structs
+ *          size_t stride       - the size of a struct in bytes
+ *          std::vector<StructField> fields - the fields bound from argPos on
+ *
+ * Output:  void* data          - the structs
+ *
+ * The device merges the fields into one buffer, which is read in one transfer.
+ */
+template<typename T>
+void Kernel<T>::getStructs(uint argPos, void* data, size_t count, size_t stride, std::vector<StructField> fields) {
+
+  ScopedTimer timer(framework->telemetry, Telemetry::GetBuffer);
+
+  if (count == 0) {
+    return;
+  }
+
+  size_t fieldBytes = 0;
+  for (uint i = 0; i < fields.size(); i++) {
+    BoundBuffer& field = resolveBuffer(argPos + i);
+    if (field.getSize() != count || field.getElementSize() != fields[i].size) {
+      raiseError("Argument " + std::to_string(argPos + i) + " does not hold " + std::to_string(count)
+        + " fields of " + std::to_string(fields[i].size) + " bytes");
+    }
+    fieldBytes += fields[i].size;
+  }
+
+  cl_mem structBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, count * stride, NULL, &status);
+  checkError("clCreateBuffer struct output");
+  framework->telemetry.count(Telemetry::BufferAllocations);
+
+  // Padding and fields which are not read back
+  if (fieldBytes < stride) {
+    cl_uchar zero = 0;
+    status = clEnqueueFillBuffer(commandQueue, structBuffer, &zero, sizeof(zero), 0, count * stride, 0, NULL, NULL);
+    checkError("clEnqueueFillBuffer struct output");
+  }
+
+  for (uint i = 0; i < fields.size(); i++) {
+    framework->builtins.mergeField(resolveBuffer(argPos + i), structBuffer, count, stride, fields[i].offset
+      , fields[i].size);
+  }
+
+  cl_event event = NULL;
+  status = clEnqueueReadBuffer(commandQueue, structBuffer, CL_TRUE, 0, count * stride, data
+    , 0, NULL, framework->profilingEvent(event));
+
+  if (status != CL_SUCCESS) {
+    clReleaseMemObject(structBuffer);
+    raiseError("clEnqueueReadBuffer structs\t" + getErrorString(status));
+  }
+  framework->telemetry.count(Telemetry::BytesFromDevice, count * stride);
+  recordTransfer(event);
+
+  status = clReleaseMemObject(structBuffer);
+  checkError("clReleaseMemObject struct output");
+}
+
+/*******************************************************/
+//  SPECIALIZATION
+/*******************************************************/
+/**
+ * Note whether a scalar about to be bound differs from the one bound before
+ */
+template<typename T>
+void Kernel<T>::compareScalar(uint argPos, const void* value, size_t size) {
+
+  auto it = boundScalars.find(argPos);
+  if (it == boundScalars.end() || it->second.getSize() != size || memcmp(it->second.getData(), value, size) != 0) {
+    scalarVersion++;
+  }
+}
+
+/**
+ * Choose the kernel for the next launch
+ *
+ * Effect:  * Changed scalars switch to the variant built for the new values
+ *            before, or back to the generic kernel
+ *          * Once the values stayed the same for specializeAfter launches,
+ *            a variant for them is built and used
+ */
+template<typename T>
+void Kernel<T>::specialize() {
+
+  // Variants stay few, values which keep changing run the generic kernel
+  const size_t maxVariants = 16;
+
+  if (scalarVersion != seenVersion) {
+    seenVersion = scalarVersion;
+
+    auto it = variants.find(scalarKey());
+    if (it != variants.end()) {
+      switchKernel(it->second != NULL ? it->second : genericKernel);
+      stableLaunches = specializeAfter;
+    } else {
+      switchKernel(genericKernel);
+      stableLaunches = 0;
+    }
+  }
+
+  if (stableLaunches >= specializeAfter || ++stableLaunches < specializeAfter) {
+    return;
+  }
+
+  if (variants.size() < maxVariants) {
+    cl_kernel variant = buildVariant();
+    variants[scalarKey()] = variant;
+    if (variant != NULL) {
+      switchKernel(variant);
+    }
+  }
+}
+
+/**
+ * The positions and bytes of the bound scalars, identifying a variant
+ */
+template<typename T>
+std::string Kernel<T>::scalarKey() {
+
+  std::string key;
+  for (auto& kv : boundScalars) {
+    key += std::to_string(kv.first) + ':' + std::string(kv.second.getData(), kv.second.getSize()) + '\0';
+  }
+  return key;
+}
+
+/**
+ * Build the kernel with the bound scalars as constants
+ *
+ * Output:  cl_kernel  - the variant, NULL when the source cannot be
+ *                       specialized (eg. an embedded binary) or fails to build
+ */
+template<typename T>
+cl_kernel Kernel<T>::buildVariant() {
+
+  std::map<uint, std::string> values;
+  for (auto& kv : boundScalars) {
+    values[kv.first] = std::string(kv.second.getData(), kv.second.getSize());
+  }
+
+  try {
+    std::string specialized;
+    if (!Specialization::rewrite(framework->getSource(sourceFile), entryName, values, specialized)) {
+      EASYOPENCL_LOG(LOG_INFO, debug, "The signature of '" << entryName << "' is not understood, '"
+        << id << "' is not specialized.");
+      return NULL;
+    }
+
+    cl_program program = framework->getProgramFromSource(specialized, buildOptions, sourceFile);
+    cl_kernel variant = clCreateKernel(program, entryName.c_str(), &status);
+    checkError("clCreateKernel specialized", entryName);
+    framework->telemetry.count(Telemetry::Specializations);
+
+    EASYOPENCL_LOG(LOG_DEBUG, debug, "Specialized '" << id << "' on " << values.size() << " scalars.");
+    return variant;
+  }
+  catch (std::exception& e) {
+    // The generic kernel still works
+    EASYOPENCL_LOG(LOG_INFO, debug, "Unable to specialize '" << id << "': " << e.what());
+    return NULL;
+  }
+}
+
+/**
+ * Launch another variant from now on, with the arguments bound so far
+ */
+template<typename T>
+void Kernel<T>::switchKernel(cl_kernel next) {
+
+  if (next == kernel) {
+    return;
+  }
+  kernel = next;
+
+  for (auto& kv : boundScalars) {
+    status = clSetKernelArg(kernel, kv.first, kv.second.getSize(), kv.second.getData());
+    checkError("clSetKernelArg specialized scalar", kv.first);
+    framework->telemetry.count(Telemetry::ArgumentSets);
+  }
+
+  // Spilled buffers are set when they are restored
+  for (auto& kv : boundBuffers) {
+    if (!kv.second.isSpilled()) {
+      setBufferArgument(kv.first);
+    }
+  }
+  for (auto& kv : boundPromises) {
+    setBufferArgument(kv.first);
+  }
+
+#ifdef CL_VERSION_2_0
+  for (auto& kv : boundSVM) {
+    status = clSetKernelArgSVMPointer(kernel, kv.first, kv.second);
+    checkError("clSetKernelArgSVMPointer specialized", kv.first);
+  }
+  svmGeneration = -1;
+#endif
+}
+
+/**
+ * Release the specialized variants, the generic kernel is used again
+ */
+template<typename T>
+void Kernel<T>::releaseVariants() {
+
+  switchKernel(genericKernel);
+
+  for (auto& kv : variants) {
+    if (kv.second != NULL) {
+      status = clReleaseKernel(kv.second);
+      checkError("clReleaseKernel variant");
+    }
+  }
+  variants.clear();
+}
+
+/*******************************************************/
+//  PROFILING
+/*******************************************************/
+template<typename T>
+cl_ulong Kernel<T>::getExecutionTime() {
+  return framework->getDuration(launchEvent);
+}
+
+/**
+ * Add the device time of a finished transfer and release its event
+ *
+ * Uploads count for the next launch, reads for the last one.
+ */
+template<typename T>
+void Kernel<T>::recordTransfer(cl_event event, bool upload) {
+
+  if (event == NULL) {
+    return;
+  }
+
+  cl_ulong duration = framework->getDuration(event);
+  transferTime += duration;
+  if (upload) {
+    uploadTime += duration;
+  } else {
+    lastTransferTime += duration;
+  }
+
+  status = clReleaseEvent(event);
+  checkError("clReleaseEvent");
+}
+
 /**
  * Utility function for pretty-printing the contents of a buffer
  *
@@ -392,6 +1319,18 @@ template<typename T>
 void Kernel<T>::showBuffers() {
   for(auto& kv : boundBuffers) {
     std::cout << kv.first << " : ";
+
+    // Arrays of other types are not printed as T
+    BoundBuffer& buffer = kv.second;
+    if (buffer.isField()) {
+      std::cout << "(field of " << buffer.getSize() << " structs)" << std::endl;
+      continue;
+    }
+    if (buffer.getStorage() == Storage::Native
+        && (buffer.holdsOtherType() || buffer.getElementSize() != sizeof(T))) {
+      std::cout << "(" << buffer.getSize() << " elements of " << buffer.getElementSize() << " bytes)" << std::endl;
+      continue;
+    }
     showBuffer(kv.first);
   }
 }
@@ -399,9 +1338,19 @@ void Kernel<T>::showBuffers() {
 template<typename T>
 void Kernel<T>::releaseMemObjects() {
   for (auto& kv : boundBuffers) {
+    if (kv.second.isSpilled()) {
+      continue;
+    }
     status = clReleaseMemObject(kv.second);
     checkError("clReleaseMemObject");
   }
+
+  for (auto& kv : boundPromises) {
+    if (kv.second.view) {
+      status = clReleaseMemObject(*kv.second.view);
+      checkError("clReleaseMemObject slice");
+    }
+  }
 }
 
 template<typename T>
@@ -0,0 +1,95 @@
+#include "kernelregistry.h"
+
+#include <map>
+#include <set>
+#include <sstream>
+
+#ifdef EASYOPENCL_BUILTIN_KERNELS
+// Generated from the built-in kernels, see src/CMakeLists.txt
+void easyopenclRegisterBuiltinKernels();
+#endif
+
+static std::map<std::string, const EmbeddedKernel*>& registry() {
+  static std::map<std::string, const EmbeddedKernel*> files;
+  return files;
+}
+
+// The registry, with the kernels of the library registered on first use
+static std::map<std::string, const EmbeddedKernel*>& entries() {
+#ifdef EASYOPENCL_BUILTIN_KERNELS
+  static bool builtins = (easyopenclRegisterBuiltinKernels(), true);
+  (void)builtins;
+#endif
+  return registry();
+}
+
+/**
+ * Register embedded files, the first file registered under a name is kept
+ */
+void KernelRegistry::add(const EmbeddedKernel* kernels, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    registry().emplace(kernels[i].name, &kernels[i]);
+  }
+}
+
+bool KernelRegistry::findSource(std::string name, std::string& contents) {
+
+  auto it = entries().find(name);
+  if (it == entries().end() || it->second->binary) {
+    return false;
+  }
+
+  contents.assign((const char*)it->second->data, it->second->size);
+  return true;
+}
+
+const EmbeddedKernel * KernelRegistry::findBinary(std::string filename) {
+
+  auto it = entries().find(filename.substr(0, filename.rfind('.')) + ".bin");
+  if (it == entries().end() || !it->second->binary) {
+    return NULL;
+  }
+  return it->second;
+}
+
+static std::string inlineIncludes(std::string source, std::set<std::string>& included) {
+
+  std::stringstream input(source);
+  std::stringstream output;
+  std::string line;
+
+  while (std::getline(input, line)) {
+
+    // #include "name", possibly indented
+    size_t hash = line.find_first_not_of(" \t");
+    size_t open = line.find('"');
+    size_t close = line.rfind('"');
+
+    std::string header;
+    if (hash != std::string::npos && line.compare(hash, 8, "#include") == 0
+        && open != std::string::npos && close > open) {
+      std::string name = line.substr(open + 1, close - open - 1);
+
+      if (KernelRegistry::findSource(name, header)) {
+        if (included.insert(name).second) {
+          output << inlineIncludes(header, included) << "\n";
+        }
+        continue;
+      }
+    }
+
+    output << line << "\n";
+  }
+
+  return output.str();
+}
+
+std::string KernelRegistry::inlineIncludes(std::string source) {
+
+  if (source.find("#include") == std::string::npos) {
+    return source;
+  }
+
+  std::set<std::string> included;
+  return ::inlineIncludes(source, included);
+}
@@ -0,0 +1,155 @@
+#include "memoryplanner.h"
+#include "easyopencl.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+/**
+ * An intermediate buffer and its lifetime in execution steps
+ */
+template<typename T>
+struct Interval {
+  Kernel<T> * kernel;
+  uint argPos;
+  size_t bytes;
+  size_t start;     // the step writing the buffer
+  size_t end;       // the last step reading it
+};
+
+/**
+ * A memory object shared by intermediates with disjoint lifetimes
+ */
+struct Slot {
+  cl_mem buffer;
+  size_t bytes;
+  size_t end;       // the last step reading the current occupant
+};
+
+/**
+ * Plan the memory of the graph which evaluating 'root' executes
+ *
+ * Input:   Kernel<T>& root - the kernel which will be evaluated
+ *
+ * Output:  MemoryPlan      - peak device memory before and after planning
+ *
+ * Effect:  * Orders the graph like evaluate() will run it
+ *          * Finds the intermediates and their lifetimes
+ *          * Assigns every intermediate to the smallest free slot which fits:
+ *            a slot is free once its occupant has been read for the last time,
+ *            or - for an in-place kernel - at the step which reads it last
+ *          * Rebinds the intermediates to the memory of their slot
+ */
+template<typename T>
+MemoryPlan MemoryPlanner<T>::plan(Kernel<T>& root) {
+
+  std::vector<Kernel<T>*> order;
+  std::set<Kernel<T>*> visited;
+  root.collectExecutionOrder(order, visited);
+
+  std::map<Kernel<T>*, size_t> step;
+  for (size_t i = 0; i < order.size(); i++) {
+    if (order[i]->getExecutionCount() != 0) {
+      raiseError("Plan the memory before evaluating, '" + order[i]->getId() + "' has been executed already");
+    }
+    step[order[i]] = i;
+  }
+
+  // The last step reading every buffer, and the buffers which have slices
+  std::map<std::pair<Kernel<T>*, uint>, size_t> lastRead;
+  std::set<cl_mem> sliced;
+
+  for (Kernel<T>* k : order) {
+    for (auto& kv : k->boundPromises) {
+      BoundPromise<T>& promise = kv.second;
+      if (promise.getView()) {
+        sliced.insert(promise.getView()->getParent());
+      } else {
+        auto key = std::make_pair(promise.getSourceKernel(), promise.getSourceArgPos());
+        lastRead[key] = std::max(lastRead[key], step[k]);
+      }
+    }
+  }
+
+  MemoryPlan result;
+  std::vector<Interval<T>> intervals;
+
+  for (Kernel<T>* k : order) {
+    for (auto& kv : k->boundBuffers) {
+      BoundBuffer& buffer = kv.second;
+      result.peakBefore += buffer.getBytes();
+
+      auto it = lastRead.find(std::make_pair(k, kv.first));
+      bool intermediate = it != lastRead.end()
+        && buffer.isOutput()
+        && k->keptBuffers.count(kv.first) == 0
+        && sliced.count(buffer) == 0
+        && !buffer.isSpilled();
+
+      if (intermediate) {
+        intervals.push_back(Interval<T> { k, kv.first, buffer.getBytes(), step[k], it->second });
+      } else {
+        result.peakAfter += buffer.getBytes();
+      }
+    }
+  }
+
+  // The intervals are ordered by their start, as the kernels are
+  std::vector<Slot> slots;
+
+  for (Interval<T>& interval : intervals) {
+
+    bool inPlace = interval.kernel->inPlace;
+    Slot * best = NULL;
+
+    for (Slot& slot : slots) {
+      bool free = slot.end < interval.start || (inPlace && slot.end == interval.start);
+      if (free && slot.bytes >= interval.bytes && (best == NULL || slot.bytes < best->bytes)) {
+        best = &slot;
+      }
+    }
+
+    BoundBuffer& buffer = interval.kernel->boundBuffers.at(interval.argPos);
+
+    if (best == NULL) {
+      // Nothing to share with, the buffer becomes a slot itself
+      slots.push_back(Slot { buffer, interval.bytes, interval.end });
+      result.peakAfter += interval.bytes;
+      result.intermediates++;
+      continue;
+    }
+
+    if (best->end == interval.start) {
+      result.inPlace++;
+    }
+    best->end = interval.end;
+
+    // Every binding holds its own reference to the shared memory object
+    status = clRetainMemObject(best->buffer);
+    checkError("clRetainMemObject planned buffer");
+    status = clReleaseMemObject(buffer);
+    checkError("clReleaseMemObject planned buffer");
+
+    buffer.reset(best->buffer, buffer.getSize());
+
+    status = clSetKernelArg(interval.kernel->kernel, interval.argPos, sizeof(cl_mem), &best->buffer);
+    checkError("clSetKernelArg planned buffer", interval.argPos);
+    framework->telemetry.count(Telemetry::ArgumentSets);
+
+    result.intermediates++;
+  }
+
+  result.allocations = slots.size();
+
+  EASYOPENCL_LOG(LOG_INFO, framework->info, "Memory plan for '" << root.getId() << "': "
+    << result.intermediates << " intermediates in " << result.allocations << " buffers ("
+    << result.inPlace << " in place), peak " << result.peakBefore << " -> "
+    << result.peakAfter << " bytes");
+
+  return result;
+}
+
+
+template class MemoryPlanner<float>;
+template class MemoryPlanner<int>;
+template class MemoryPlanner<double>;
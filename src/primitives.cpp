@@ -0,0 +1,704 @@
+#include "primitives.h"
+#include "easyopencl.h"
+#include "typetraits.h"
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+// Number of bits sorted per radix sort pass, must match radixsort.cl
+#define RADIX_BITS 4
+
+/*******************************************************/
+//  Build options describing the radix sort keys
+/*******************************************************/
+template<typename T> struct RadixKey;
+
+template<> struct RadixKey<int> {
+  static std::string buildOptions() { return " -D K=uint -D AS_K=as_uint -D KEY_BITS=32"; }
+};
+
+template<> struct RadixKey<float> {
+  static std::string buildOptions() { return " -D K=uint -D AS_K=as_uint -D KEY_BITS=32 -D KEY_FLOAT"; }
+};
+
+template<> struct RadixKey<double> {
+  static std::string buildOptions() { return " -D K=ulong -D AS_K=as_ulong -D KEY_BITS=64 -D KEY_FLOAT"; }
+};
+
+/*******************************************************/
+//  Build options for atomic updates of T values
+//  float and double compare and swap their bits
+/*******************************************************/
+template<typename T> struct AtomicTraits;
+
+template<> struct AtomicTraits<int> {
+  static std::string buildOptions() { return ""; }
+  static std::string minimum() { return "INT_MIN"; }
+  static std::string maximum() { return "INT_MAX"; }
+  static bool native() { return true; }
+};
+
+template<> struct AtomicTraits<float> {
+  static std::string buildOptions() { return " -D U=uint -D AS_U=as_uint -D AS_T=as_float -D CMPXCHG=atomic_cmpxchg"; }
+  static std::string minimum() { return "(-INFINITY)"; }
+  static std::string maximum() { return "INFINITY"; }
+  static bool native() { return false; }
+};
+
+template<> struct AtomicTraits<double> {
+  static std::string buildOptions() {
+    return " -D U=ulong -D AS_U=as_ulong -D AS_T=as_double -D CMPXCHG=atom_cmpxchg -D ENABLE_INT64_ATOMICS";
+  }
+  static std::string minimum() { return "(-INFINITY)"; }
+  static std::string maximum() { return "INFINITY"; }
+  static bool native() { return false; }
+};
+
+/******************************************************************************/
+//  SCAN
+/******************************************************************************/
+template<typename T>
+void Primitives<T>::exclusiveScan(Kernel<T>& k, uint argPos) {
+  Kernel<T> * owner;
+  uint ownerPos;
+  BoundBuffer& buffer = ownerBuffer(k, argPos, owner, ownerPos);
+
+  scan(buffer, buffer.getSize(), false, false);
+}
+
+template<typename T>
+void Primitives<T>::inclusiveScan(Kernel<T>& k, uint argPos) {
+  Kernel<T> * owner;
+  uint ownerPos;
+  BoundBuffer& buffer = ownerBuffer(k, argPos, owner, ownerPos);
+
+  scan(buffer, buffer.getSize(), true, false);
+}
+
+/**
+ * Work-efficient scan of a device buffer
+ *
+ * Input:   cl_mem buffer   - the values, scanned in place
+ *          uint length     - the number of elements in the buffer
+ *          bool inclusive  - inclusive or exclusive prefix sums
+ *          bool integer    - scan cl_int values instead of T values
+ *
+ * Effect:  * Every work group scans a block of twice its size in local memory
+ *          * The block totals are scanned recursively
+ *          * The scanned totals are added to the blocks
+ */
+template<typename T>
+void Primitives<T>::scan(cl_mem buffer, uint length, bool inclusive, bool integer) {
+
+  if (length == 0) {
+    return;
+  }
+
+  std::string options = integer ? TypeTraits<int>::buildOptions() : TypeTraits<T>::buildOptions();
+  size_t elementSize = integer ? sizeof(cl_int) : sizeof(T);
+
+  cl_kernel scanBlocks = getKernel("scan.cl", "scan_blocks", options);
+  cl_kernel scanAdd = getKernel("scan.cl", "scan_add", options);
+
+  size_t groupSize = std::min(getGroupSize(scanBlocks), getGroupSize(scanAdd));
+  size_t blockSize = groupSize * 2;
+  uint numBlocks = (length + blockSize - 1) / blockSize;
+
+  cl_mem blockSums = createBuffer(numBlocks * elementSize);
+  cl_int includeSelf = inclusive;
+
+  setArg(scanBlocks, 0, sizeof(cl_mem), &buffer);
+  setArg(scanBlocks, 1, sizeof(cl_mem), &blockSums);
+  setArg(scanBlocks, 2, blockSize * elementSize, NULL);
+  setArg(scanBlocks, 3, sizeof(cl_uint), &length);
+  setArg(scanBlocks, 4, sizeof(cl_int), &includeSelf);
+  launch(scanBlocks, numBlocks * groupSize, groupSize, "scan_blocks");
+
+  // A single block is complete, otherwise offset every block by the
+  // exclusive scan of the totals of the blocks before it
+  if (numBlocks > 1) {
+    scan(blockSums, numBlocks, false, integer);
+
+    setArg(scanAdd, 0, sizeof(cl_mem), &buffer);
+    setArg(scanAdd, 1, sizeof(cl_mem), &blockSums);
+    setArg(scanAdd, 2, sizeof(cl_uint), &length);
+    launch(scanAdd, numBlocks * groupSize, groupSize, "scan_add");
+  }
+
+  status = clReleaseMemObject(blockSums);
+  checkError("clReleaseMemObject blockSums");
+}
+
+/******************************************************************************/
+//  STREAM COMPACTION
+/******************************************************************************/
+/**
+ * Remove the elements which do not satisfy a predicate
+ *
+ * Input:   Kernel<T>& k            - the kernel the buffer is bound to
+ *          uint argPos             - the position of the buffer
+ *          std::string predicate   - OpenCL C expression in terms of 'x'
+ *
+ * Output:  uint                    - the number of elements kept
+ *
+ * Effect:  * Flag the elements, an inclusive scan of the flags gives their
+ *            position in the output
+ *          * Scatter the flagged elements into a new buffer which replaces
+ *            the bound buffer
+ *          * The owner of the buffer and the kernels with a promise of it
+ *            launch over the kept elements from now on
+ */
+template<typename T>
+uint Primitives<T>::compact(Kernel<T>& k, uint argPos, std::string predicate) {
+
+  Kernel<T> * owner;
+  uint ownerPos;
+  BoundBuffer& buffer = ownerBuffer(k, argPos, owner, ownerPos);
+  uint length = buffer.getSize();
+
+  if (buffer.isView()) {
+    raiseError("A slice cannot be compacted, it cannot change its size");
+  }
+
+  if (length == 0) {
+    return 0;
+  }
+
+  std::string options = TypeTraits<T>::buildOptions();
+  std::string header = "#define PREDICATE(x) (" + predicate + ")\n";
+
+  cl_kernel flagKernel = getKernel("compact.cl", "compact_flags", options, header);
+  cl_kernel scatterKernel = getKernel("compact.cl", "compact_scatter", options, header);
+
+  size_t groupSize = std::min(getGroupSize(flagKernel), getGroupSize(scatterKernel));
+  size_t globalSize = (length + groupSize - 1) / groupSize * groupSize;
+
+  cl_mem input = buffer;
+  cl_mem flags = createBuffer(length * sizeof(cl_int));
+  cl_mem positions = createBuffer(length * sizeof(cl_int));
+
+  setArg(flagKernel, 0, sizeof(cl_mem), &input);
+  setArg(flagKernel, 1, sizeof(cl_mem), &flags);
+  setArg(flagKernel, 2, sizeof(cl_mem), &positions);
+  setArg(flagKernel, 3, sizeof(cl_uint), &length);
+  launch(flagKernel, globalSize, groupSize, "compact_flags");
+
+  scan(positions, length, true, true);
+
+  // The last inclusive prefix sum is the number of elements kept
+  cl_int count = 0;
+  status = clEnqueueReadBuffer(framework->commandQueue, positions, CL_TRUE
+    , (length - 1) * sizeof(cl_int), sizeof(cl_int), &count, 0, NULL, NULL);
+  checkError("clEnqueueReadBuffer compaction count");
+  framework->telemetry.count(Telemetry::BytesFromDevice, sizeof(cl_int));
+
+  // Never create an empty buffer, OpenCL does not allow it
+  cl_mem output = createBuffer(std::max(count, 1) * sizeof(T));
+
+  setArg(scatterKernel, 0, sizeof(cl_mem), &input);
+  setArg(scatterKernel, 1, sizeof(cl_mem), &flags);
+  setArg(scatterKernel, 2, sizeof(cl_mem), &positions);
+  setArg(scatterKernel, 3, sizeof(cl_mem), &output);
+  setArg(scatterKernel, 4, sizeof(cl_uint), &length);
+  launch(scatterKernel, globalSize, groupSize, "compact_scatter");
+
+  // Swap the compacted buffer in
+  buffer.reset(output, count);
+  setArg(owner->kernel, ownerPos, sizeof(cl_mem), &output);
+
+  // The range of whoever took its length from the buffer shrinks with it,
+  // the linked kernels would read past the end otherwise
+  owner->vectorSize = count;
+  for (auto& kv : framework->kernels) {
+    Kernel<T>& reader = kv.second;
+    for (auto& promise : reader.boundPromises) {
+      Kernel<T> * source;
+      uint sourcePos;
+      reader.resolveOwner(promise.first, source, sourcePos);
+      if (source == owner && sourcePos == ownerPos) {
+        reader.vectorSize = count;
+      }
+    }
+  }
+
+  status = clReleaseMemObject(input);
+  checkError("clReleaseMemObject compaction input");
+  status = clReleaseMemObject(flags);
+  checkError("clReleaseMemObject compaction flags");
+  status = clReleaseMemObject(positions);
+  checkError("clReleaseMemObject compaction positions");
+
+  return count;
+}
+
+/******************************************************************************/
+//  RADIX SORT
+/******************************************************************************/
+/**
+ * Sort a buffer in ascending order
+ *
+ * Input:   Kernel<T>& k  - the kernel the buffer is bound to
+ *          uint argPos   - the position of the buffer
+ *
+ * Effect:  Per pass of RADIX_BITS bits, starting at the least significant:
+ *          * Every work group counts the digits of its elements
+ *          * An exclusive scan of the (digit-major) counts gives the offset
+ *            of every digit of every work group in the output
+ *          * The elements are scattered stably to their offset
+ *          The values are ping-ponged with a second buffer, the number of
+ *          passes is even so the result ends up in the bound buffer.
+ */
+template<typename T>
+void Primitives<T>::radixSort(Kernel<T>& k, uint argPos) {
+
+  Kernel<T> * owner;
+  uint ownerPos;
+  BoundBuffer& buffer = ownerBuffer(k, argPos, owner, ownerPos);
+  uint length = buffer.getSize();
+
+  if (length < 2) {
+    return;
+  }
+
+  std::string options = TypeTraits<T>::buildOptions() + RadixKey<T>::buildOptions();
+
+  cl_kernel countKernel = getKernel("radixsort.cl", "radix_count", options);
+  cl_kernel scatterKernel = getKernel("radixsort.cl", "radix_scatter", options);
+
+  size_t groupSize = std::min(getGroupSize(countKernel), getGroupSize(scatterKernel));
+  uint numGroups = (length + groupSize - 1) / groupSize;
+  uint histogramLength = (1 << RADIX_BITS) * numGroups;
+
+  cl_mem source = buffer;
+  cl_mem target = createBuffer(length * sizeof(T));
+  cl_mem histogram = createBuffer(histogramLength * sizeof(cl_int));
+
+  for (cl_uint shift = 0; shift < sizeof(T) * 8; shift += RADIX_BITS) {
+
+    setArg(countKernel, 0, sizeof(cl_mem), &source);
+    setArg(countKernel, 1, sizeof(cl_mem), &histogram);
+    setArg(countKernel, 2, (1 << RADIX_BITS) * sizeof(cl_int), NULL);
+    setArg(countKernel, 3, sizeof(cl_uint), &length);
+    setArg(countKernel, 4, sizeof(cl_uint), &shift);
+    launch(countKernel, numGroups * groupSize, groupSize, "radix_count");
+
+    scan(histogram, histogramLength, false, true);
+
+    setArg(scatterKernel, 0, sizeof(cl_mem), &source);
+    setArg(scatterKernel, 1, sizeof(cl_mem), &target);
+    setArg(scatterKernel, 2, sizeof(cl_mem), &histogram);
+    setArg(scatterKernel, 3, groupSize * sizeof(cl_uint), NULL);
+    setArg(scatterKernel, 4, groupSize * sizeof(cl_uint), NULL);
+    setArg(scatterKernel, 5, (1 << RADIX_BITS) * sizeof(cl_uint), NULL);
+    setArg(scatterKernel, 6, sizeof(cl_uint), &length);
+    setArg(scatterKernel, 7, sizeof(cl_uint), &shift);
+    launch(scatterKernel, numGroups * groupSize, groupSize, "radix_scatter");
+
+    std::swap(source, target);
+  }
+
+  status = clReleaseMemObject(target);
+  checkError("clReleaseMemObject radix sort buffer");
+  status = clReleaseMemObject(histogram);
+  checkError("clReleaseMemObject radix sort histogram");
+}
+
+/******************************************************************************/
+//  HISTOGRAM AND GROUP BY
+/******************************************************************************/
+/**
+ * Count the keys in a buffer
+ *
+ * Input:   Kernel<T>& k  - the kernel the keys are bound to
+ *          uint keyPos   - the position of the keys, int or T
+ *          uint bins     - the number of keys, others are skipped
+ *
+ * Output:  std::vector<uint>  - the count of every key in [0, bins)
+ */
+template<typename T>
+std::vector<uint> Primitives<T>::histogram(Kernel<T>& k, uint keyPos, uint bins) {
+
+  Kernel<T> * owner;
+  uint ownerPos;
+  BoundBuffer& keys = ownerBuffer(k, keyPos, owner, ownerPos);
+  uint length = keys.getSize();
+
+  std::vector<uint> counts(bins);
+  if (bins == 0) {
+    return counts;
+  }
+
+  std::string options = TypeTraits<T>::buildOptions() + keyOptions(keys);
+
+  cl_mem table = createBuffer(bins * sizeof(cl_uint));
+  cl_mem keyBuffer = keys;
+
+  cl_kernel clearKernel = getKernel("groupby.cl", "histogram_clear", options);
+  setArg(clearKernel, 0, sizeof(cl_mem), &table);
+  setArg(clearKernel, 1, sizeof(cl_uint), &bins);
+  size_t clearGroup = getGroupSize(clearKernel);
+  launch(clearKernel, (bins + clearGroup - 1) / clearGroup * clearGroup, clearGroup, "histogram_clear");
+
+  if (length) {
+    bool privatize = fitsLocalMemory(bins * sizeof(cl_uint));
+    std::string name = privatize ? "histogram_local" : "histogram_global";
+    cl_kernel histogramKernel = getKernel("groupby.cl", name, options);
+
+    uint arg = 0;
+    setArg(histogramKernel, arg++, sizeof(cl_mem), &keyBuffer);
+    setArg(histogramKernel, arg++, sizeof(cl_mem), &table);
+    if (privatize) {
+      setArg(histogramKernel, arg++, bins * sizeof(cl_uint), NULL);
+    }
+    setArg(histogramKernel, arg++, sizeof(cl_uint), &length);
+    setArg(histogramKernel, arg++, sizeof(cl_uint), &bins);
+
+    size_t groupSize = getGroupSize(histogramKernel);
+    launch(histogramKernel, getStridedSize(length, groupSize), groupSize, name);
+  }
+
+  readTable(table, &counts[0], bins * sizeof(cl_uint));
+  return counts;
+}
+
+/**
+ * Aggregate the values of every key
+ *
+ * Input:   Kernel<T>& k        - the kernel the buffers are bound to
+ *          uint keyPos         - the position of the keys, int or T
+ *          uint valuePos       - the position of the values, as long as the keys
+ *          uint bins           - the number of keys, others are skipped
+ *          Aggregate aggregate - Sum, Count, Min or Max
+ *
+ * Output:  std::vector<T>      - the aggregate of every key in [0, bins), keys
+ *                                without values hold 0 for Sum and Count,
+ *                                the largest value for Min and the smallest
+ *                                for Max
+ *
+ * Effect:  When the table fits in local memory, every work group aggregates
+ *          into a private copy first and merges it into the global table with
+ *          one atomic per bin, otherwise every element updates the global
+ *          table directly. Integers use the atomic functions, float and double
+ *          a compare and swap loop.
+ */
+template<typename T>
+std::vector<T> Primitives<T>::groupBy(Kernel<T>& k, uint keyPos, uint valuePos, uint bins, Aggregate aggregate) {
+
+  if (aggregate == Aggregate::Count) {
+    std::vector<uint> counts = histogram(k, keyPos, bins);
+    return std::vector<T>(counts.begin(), counts.end());
+  }
+
+  Kernel<T> * owner;
+  uint ownerPos;
+  BoundBuffer& keys = ownerBuffer(k, keyPos, owner, ownerPos);
+  BoundBuffer& values = ownerBuffer(k, valuePos, owner, ownerPos);
+  uint length = keys.getSize();
+
+  if (values.getSize() != length) {
+    raiseError("Group by needs as many values (" + std::to_string(values.getSize())
+      + ") as keys (" + std::to_string(length) + ")");
+  }
+
+  // The values are aggregated as T, like the result
+  if (values.getStorage() != Storage::Native || values.getElementSize() != sizeof(T) || values.holdsOtherType()) {
+    raiseError("The values have to be " + TypeTraits<T>::name());
+  }
+
+  std::vector<T> result(bins);
+  if (bins == 0) {
+    return result;
+  }
+
+  std::string header;
+  std::string atomicFunction;
+  switch (aggregate) {
+    case Aggregate::Sum:
+      header = "#define OP(a, b) ((a) + (b))\n#define IDENTITY 0\n";
+      atomicFunction = "atomic_add";
+      break;
+    case Aggregate::Min:
+      header = "#define OP(a, b) min(a, b)\n#define IDENTITY " + AtomicTraits<T>::maximum() + "\n";
+      atomicFunction = "atomic_min";
+      break;
+    default:
+      header = "#define OP(a, b) max(a, b)\n#define IDENTITY " + AtomicTraits<T>::minimum() + "\n";
+      atomicFunction = "atomic_max";
+      break;
+  }
+  if (AtomicTraits<T>::native()) {
+    header += "#define ATOMIC_OP " + atomicFunction + "\n";
+  }
+
+  std::string options = TypeTraits<T>::buildOptions() + AtomicTraits<T>::buildOptions() + keyOptions(keys);
+
+  cl_mem table = createBuffer(bins * sizeof(T));
+  cl_mem keyBuffer = keys;
+  cl_mem valueBuffer = values;
+
+  cl_kernel fillKernel = getKernel("groupby.cl", "groupby_fill", options, header);
+  setArg(fillKernel, 0, sizeof(cl_mem), &table);
+  setArg(fillKernel, 1, sizeof(cl_uint), &bins);
+  size_t fillGroup = getGroupSize(fillKernel);
+  launch(fillKernel, (bins + fillGroup - 1) / fillGroup * fillGroup, fillGroup, "groupby_fill");
+
+  if (length) {
+    bool privatize = fitsLocalMemory(bins * sizeof(T));
+    std::string name = privatize ? "groupby_local" : "groupby_global";
+    cl_kernel groupKernel = getKernel("groupby.cl", name, options, header);
+
+    uint arg = 0;
+    setArg(groupKernel, arg++, sizeof(cl_mem), &keyBuffer);
+    setArg(groupKernel, arg++, sizeof(cl_mem), &valueBuffer);
+    setArg(groupKernel, arg++, sizeof(cl_mem), &table);
+    if (privatize) {
+      setArg(groupKernel, arg++, bins * sizeof(T), NULL);
+    }
+    setArg(groupKernel, arg++, sizeof(cl_uint), &length);
+    setArg(groupKernel, arg++, sizeof(cl_uint), &bins);
+
+    size_t groupSize = getGroupSize(groupKernel);
+    launch(groupKernel, getStridedSize(length, groupSize), groupSize, name);
+  }
+
+  readTable(table, &result[0], bins * sizeof(T));
+  return result;
+}
+
+/**
+ * The type of the keys for the aggregation kernels
+ *
+ * Output:  std::string  - the build option defining KEY: int for arrays of
+ *                         int (and int kernels), T for buffers of the kernel
+ */
+template<typename T>
+std::string Primitives<T>::keyOptions(BoundBuffer& keys) {
+
+  if (keys.holdsInt() || (std::is_same<T, int>::value && !keys.holdsOtherType())) {
+    return " -D KEY=int";
+  }
+
+  if (keys.getStorage() != Storage::Native || keys.getElementSize() != sizeof(T) || keys.holdsOtherType()) {
+    raiseError("The keys have to be int (bindArray with a std::vector<int>) or " + TypeTraits<T>::name());
+  }
+  return " -D KEY=" + TypeTraits<T>::name();
+}
+
+/**
+ * Whether a table can be privatized: at most half of the local memory, so
+ * the work group still fits next to it
+ */
+template<typename T>
+bool Primitives<T>::fitsLocalMemory(size_t bytes) {
+
+  cl_ulong localMemory;
+  status = clGetDeviceInfo(framework->devices[0], CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemory, NULL);
+  checkError("clGetDeviceInfo CL_DEVICE_LOCAL_MEM_SIZE");
+
+  return bytes <= localMemory / 2;
+}
+
+/**
+ * The global size for a kernel which strides over 'length' elements: enough
+ * work groups to fill the device, few enough to amortize their private tables
+ */
+template<typename T>
+size_t Primitives<T>::getStridedSize(uint length, size_t groupSize) {
+
+  cl_uint computeUnits;
+  status = clGetDeviceInfo(framework->devices[0], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+  checkError("clGetDeviceInfo CL_DEVICE_MAX_COMPUTE_UNITS");
+
+  size_t numGroups = std::min((length + groupSize - 1) / groupSize, (size_t)computeUnits * 4);
+  return std::max(numGroups, (size_t)1) * groupSize;
+}
+
+/**
+ * Read an aggregation table back and release it
+ */
+template<typename T>
+void Primitives<T>::readTable(cl_mem table, void* host, size_t bytes) {
+
+  status = clEnqueueReadBuffer(framework->commandQueue, table, CL_TRUE, 0, bytes, host, 0, NULL, NULL);
+  checkError("clEnqueueReadBuffer aggregation table");
+  framework->telemetry.count(Telemetry::BytesFromDevice, bytes);
+
+  status = clReleaseMemObject(table);
+  checkError("clReleaseMemObject aggregation table");
+}
+
+/******************************************************************************/
+//  STORAGE CONVERSION
+/******************************************************************************/
+template<typename T>
+void Primitives<T>::convert(cl_mem input, cl_mem output, uint length, Storage storage) {
+
+  std::string name = (storage == Storage::Half) ? "float_to_half" : "float_to_bfloat16";
+  cl_kernel convertKernel = getKernel("convert.cl", name, "");
+
+  size_t groupSize = getGroupSize(convertKernel);
+  size_t globalSize = (length + groupSize - 1) / groupSize * groupSize;
+
+  setArg(convertKernel, 0, sizeof(cl_mem), &input);
+  setArg(convertKernel, 1, sizeof(cl_mem), &output);
+  setArg(convertKernel, 2, sizeof(cl_uint), &length);
+  launch(convertKernel, globalSize, groupSize, name);
+}
+
+/******************************************************************************/
+//  STRUCT TRANSPOSITION
+/******************************************************************************/
+/**
+ * Copy one field of every struct into a field array
+ *
+ * Input:   cl_mem structs  - count structs of stride bytes
+ *          cl_mem field    - count fields of size bytes
+ *          size_t offset   - the offset of the field in the struct
+ */
+template<typename T>
+void Primitives<T>::splitField(cl_mem structs, cl_mem field, uint count, size_t stride, size_t offset, size_t size) {
+  transposeField("split_field", structs, field, count, stride, offset, size);
+}
+
+/**
+ * Copy a field array into one field of every struct, the other fields are
+ * left as they are
+ */
+template<typename T>
+void Primitives<T>::mergeField(cl_mem field, cl_mem structs, uint count, size_t stride, size_t offset, size_t size) {
+  transposeField("merge_field", field, structs, count, stride, offset, size);
+}
+
+template<typename T>
+void Primitives<T>::transposeField(std::string name, cl_mem input, cl_mem output, uint count
+                                  , size_t stride, size_t offset, size_t size) {
+
+  // Whole words where the layout allows it
+  size_t wordSize = (stride % 4 == 0 && offset % 4 == 0 && size % 4 == 0) ? 4 : 1;
+  cl_kernel transposeKernel = getKernel("structs.cl", name, wordSize == 4 ? "-D WORD=uint" : "-D WORD=uchar");
+
+  cl_uint words = size / wordSize;
+  cl_uint strideWords = stride / wordSize;
+  cl_uint offsetWords = offset / wordSize;
+
+  size_t groupSize = getGroupSize(transposeKernel);
+  size_t globalSize = ((size_t)count * words + groupSize - 1) / groupSize * groupSize;
+
+  setArg(transposeKernel, 0, sizeof(cl_mem), &input);
+  setArg(transposeKernel, 1, sizeof(cl_mem), &output);
+  setArg(transposeKernel, 2, sizeof(cl_uint), &count);
+  setArg(transposeKernel, 3, sizeof(cl_uint), &strideWords);
+  setArg(transposeKernel, 4, sizeof(cl_uint), &offsetWords);
+  setArg(transposeKernel, 5, sizeof(cl_uint), &words);
+  launch(transposeKernel, globalSize, groupSize, name);
+}
+
+/******************************************************************************/
+//  HELPERS
+/******************************************************************************/
+/**
+ * Fetch a built-in kernel, building its program on first use
+ *
+ * Input:   std::string filename  - the .cl file containing the kernel
+ *          std::string name      - the name of the entry function
+ *          std::string options   - build options (types, keys)
+ *          std::string header    - source placed in front of the file
+ */
+template<typename T>
+cl_kernel Primitives<T>::getKernel(std::string filename, std::string name
+                                  , std::string options, std::string header) {
+
+  std::string kernelKey = filename + '\n' + options + '\n' + header + '\n' + name;
+
+  auto it = kernels.find(kernelKey);
+  if (it != kernels.end()) {
+    return it->second;
+  }
+
+  // The framework keeps the program
+  cl_program program = framework->getProgram(filename, options, header);
+
+  cl_kernel kernel = clCreateKernel(program, name.c_str(), &status);
+  checkError("clCreateKernel", name);
+
+  kernels[kernelKey] = kernel;
+  return kernel;
+}
+
+/**
+ * The work group size for a built-in kernel: a power of two, at most 256
+ */
+template<typename T>
+size_t Primitives<T>::getGroupSize(cl_kernel kernel) {
+
+  size_t maxGroupSize;
+  status = clGetKernelWorkGroupInfo(kernel, framework->devices[0], CL_KERNEL_WORK_GROUP_SIZE
+    , sizeof(size_t), &maxGroupSize, NULL);
+  checkError("clGetKernelWorkGroupInfo");
+
+  size_t groupSize = 1;
+  while (groupSize * 2 <= std::min(maxGroupSize, (size_t)256)) {
+    groupSize *= 2;
+  }
+  return groupSize;
+}
+
+template<typename T>
+cl_mem Primitives<T>::createBuffer(size_t bytes) {
+  cl_mem buffer = clCreateBuffer(framework->context, CL_MEM_READ_WRITE, bytes, NULL, &status);
+  checkError("clCreateBuffer primitive");
+  framework->telemetry.count(Telemetry::BufferAllocations);
+  return buffer;
+}
+
+template<typename T>
+void Primitives<T>::setArg(cl_kernel kernel, cl_uint argPos, size_t size, const void* value) {
+  status = clSetKernelArg(kernel, argPos, size, value);
+  checkError("clSetKernelArg primitive", argPos);
+  framework->telemetry.count(Telemetry::ArgumentSets);
+}
+
+template<typename T>
+void Primitives<T>::launch(cl_kernel kernel, size_t globalSize, size_t localSize, std::string name) {
+  status = clEnqueueNDRangeKernel(framework->commandQueue, kernel, 1, NULL
+    , &globalSize, &localSize, 0, NULL, NULL);
+  checkError("Running primitive", name);
+  framework->telemetry.count(Telemetry::Launches);
+}
+
+/**
+ * Find the kernel which owns the buffer behind an argument
+ *
+ * Input:   Kernel<T>& k    - the kernel
+ *          uint argPos     - the argument, a buffer or a promise
+ *
+ * Output:  BoundBuffer&    - the buffer
+ *          owner, ownerPos - the kernel and position the buffer is bound to
+ */
+template<typename T>
+BoundBuffer& Primitives<T>::ownerBuffer(Kernel<T>& k, uint argPos, Kernel<T>*& owner, uint& ownerPos) {
+
+  k.resolveOwner(argPos, owner, ownerPos);
+  BoundBuffer& buffer = k.resolveBuffer(argPos);
+
+  if (buffer.getStorage() != Storage::Native) {
+    raiseError("Primitives only operate on buffers with native storage");
+  }
+  return buffer;
+}
+
+template<typename T>
+void Primitives<T>::release() {
+
+  for (auto& kv : kernels) {
+    status = clReleaseKernel(kv.second);
+    checkError("clReleaseKernel primitive");
+  }
+  kernels.clear();
+}
+
+
+template class Primitives<float>;
+template class Primitives<int>;
+template class Primitives<double>;
@@ -0,0 +1,164 @@
+#include "sharedmemory.h"
+
+#include <algorithm>
+#include <string>
+
+/**
+ * Look up which kind of shared virtual memory the device offers
+ *
+ * Input:   cl_context* context_            - the context of the framework
+ *          cl_command_queue* commandQueue_ - its queue, which may be recreated
+ *          cl_device_id device             - the device of the framework
+ */
+void SharedMemory::init(cl_context* context_, cl_command_queue* commandQueue_, cl_device_id device) {
+
+  context = context_;
+  commandQueue = commandQueue_;
+  capabilities = 0;
+
+#ifdef CL_VERSION_2_0
+  // Devices below OpenCL 2.0 reject the query, they have no SVM
+  cl_bitfield deviceCapabilities;
+  if (clGetDeviceInfo(device, CL_DEVICE_SVM_CAPABILITIES, sizeof(cl_bitfield), &deviceCapabilities, NULL) == CL_SUCCESS) {
+    capabilities = deviceCapabilities;
+  }
+#endif
+}
+
+bool SharedMemory::isFineGrained() {
+#ifdef CL_VERSION_2_0
+  return capabilities & (CL_DEVICE_SVM_FINE_GRAIN_BUFFER | CL_DEVICE_SVM_FINE_GRAIN_SYSTEM);
+#else
+  return false;
+#endif
+}
+
+/**
+ * Allocate shared memory, mapped for the host when it is coarse-grained
+ *
+ * Input:   size_t size - in bytes
+ *
+ * Output:  void*       - valid on the host and in kernels
+ */
+void * SharedMemory::allocate(size_t size) {
+
+#ifdef CL_VERSION_2_0
+  if (!isSupported()) {
+    raiseError("The device does not support shared virtual memory");
+  }
+
+  cl_svm_mem_flags flags = CL_MEM_READ_WRITE;
+  if (isFineGrained()) {
+    flags |= CL_MEM_SVM_FINE_GRAIN_BUFFER;
+    if (capabilities & CL_DEVICE_SVM_ATOMICS) {
+      flags |= CL_MEM_SVM_ATOMICS;
+    }
+  }
+
+  // OpenCL does not allow empty allocations
+  void * pointer = clSVMAlloc(*context, flags, std::max(size, (size_t)1), 0);
+  if (pointer == NULL) {
+    raiseError("clSVMAlloc of " + std::to_string(size) + " bytes failed");
+  }
+
+  if (!isFineGrained() && mapped) {
+    status = clEnqueueSVMMap(*commandQueue, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, pointer, size, 0, NULL, NULL);
+    checkError("clEnqueueSVMMap");
+  }
+
+  allocations.emplace(pointer, size);
+  generation++;
+  return pointer;
+#else
+  raiseError("Shared virtual memory needs OpenCL 2.0");
+  return NULL;
+#endif
+}
+
+void SharedMemory::free(void* pointer) {
+
+#ifdef CL_VERSION_2_0
+  // Allocations are already gone after cleanup()
+  auto it = allocations.find(pointer);
+  if (it == allocations.end()) {
+    return;
+  }
+
+  if (!isFineGrained() && mapped) {
+    status = clEnqueueSVMUnmap(*commandQueue, pointer, 0, NULL, NULL);
+    checkError("clEnqueueSVMUnmap");
+  }
+
+  // Waits for the kernels using the memory
+  status = clFinish(*commandQueue);
+  checkError("clFinish");
+
+  clSVMFree(*context, pointer);
+  allocations.erase(it);
+  generation++;
+#endif
+}
+
+/**
+ * Make the allocations available to the next kernel
+ *
+ * Effect:  Unmaps coarse-grained allocations, fine-grained ones are shared anyway
+ */
+void SharedMemory::release() {
+
+#ifdef CL_VERSION_2_0
+  if (isFineGrained() || !mapped) {
+    return;
+  }
+
+  for (auto& kv : allocations) {
+    status = clEnqueueSVMUnmap(*commandQueue, kv.first, 0, NULL, NULL);
+    checkError("clEnqueueSVMUnmap");
+  }
+  mapped = false;
+#endif
+}
+
+/**
+ * Make the allocations available to the host again
+ *
+ * Effect:  Blocks until the kernels before it finished, mapping
+ *          coarse-grained allocations
+ */
+void SharedMemory::acquire() {
+
+#ifdef CL_VERSION_2_0
+  if (isFineGrained()) {
+    status = clFinish(*commandQueue);
+    checkError("clFinish");
+    return;
+  }
+
+  if (mapped) {
+    return;
+  }
+
+  for (auto& kv : allocations) {
+    status = clEnqueueSVMMap(*commandQueue, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, kv.first, kv.second, 0, NULL, NULL);
+    checkError("clEnqueueSVMMap");
+  }
+  mapped = true;
+#endif
+}
+
+std::vector<void*> SharedMemory::getPointers() {
+
+  std::vector<void*> pointers;
+  for (auto& kv : allocations) {
+    pointers.push_back(kv.first);
+  }
+  return pointers;
+}
+
+void SharedMemory::cleanup() {
+
+  // Free everything the containers have not freed yet
+  while (!allocations.empty()) {
+    free(allocations.begin()->first);
+  }
+}
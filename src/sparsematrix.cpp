@@ -0,0 +1,189 @@
+#include "sparsematrix.h"
+
+#include <algorithm>
+#include <numeric>
+
+template<typename T> const cl_uint SparseMatrix<T>::ELL_PADDING;
+template<typename T> const uint SparseMatrix<T>::SLICE_HEIGHT;
+
+/**
+ * Construct a CSR matrix
+ *
+ * Input:   uint rows_, columns_              - the dimensions
+ *          std::vector<cl_uint> rowPointers_ - rows + 1 offsets, starting at 0
+ *          std::vector<cl_uint> columnIndices_, std::vector<T> values_
+ *                                            - the non-zeros, row by row
+ */
+template<typename T>
+SparseMatrix<T>::SparseMatrix(uint rows_, uint columns_, std::vector<cl_uint> rowPointers_
+                             , std::vector<cl_uint> columnIndices_, std::vector<T> values_) {
+  rows = rows_;
+  columns = columns_;
+  rowPointers = std::move(rowPointers_);
+  columnIndices = std::move(columnIndices_);
+  values = std::move(values_);
+
+  if (rowPointers.size() != rows + 1 || rowPointers[0] != 0 || rowPointers[rows] != values.size()) {
+    raiseError("The row pointers do not describe " + std::to_string(rows) + " rows of "
+      + std::to_string(values.size()) + " non-zeros");
+  }
+  if (columnIndices.size() != values.size()) {
+    raiseError("There are " + std::to_string(columnIndices.size()) + " column indices for "
+      + std::to_string(values.size()) + " values");
+  }
+  for (uint row = 0; row < rows; row++) {
+    if (rowPointers[row] > rowPointers[row + 1]) {
+      raiseError("The row pointers decrease at row " + std::to_string(row));
+    }
+  }
+  for (cl_uint column : columnIndices) {
+    if (column >= columns) {
+      raiseError("Column index " + std::to_string(column) + " is outside of the "
+        + std::to_string(columns) + " columns");
+    }
+  }
+}
+
+/**
+ * Build a CSR matrix from coordinates
+ *
+ * Input:   uint rows, columns                    - the dimensions
+ *          const std::vector<cl_uint>& rowIndex  - the row of every entry
+ *          const std::vector<cl_uint>& colIndex  - the column of every entry
+ *          const std::vector<T>& entries         - the values
+ */
+template<typename T>
+SparseMatrix<T> SparseMatrix<T>::fromTriplets(uint rows, uint columns, const std::vector<cl_uint>& rowIndex
+                                             , const std::vector<cl_uint>& colIndex, const std::vector<T>& entries) {
+
+  // Sorting indexes all three, before the constructor could check anything
+  if (rowIndex.size() != entries.size() || colIndex.size() != entries.size()) {
+    ErrorHandler().raiseError("There are " + std::to_string(rowIndex.size()) + " row and "
+      + std::to_string(colIndex.size()) + " column indices for " + std::to_string(entries.size()) + " entries");
+  }
+
+  std::vector<size_t> order(entries.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return rowIndex[a] != rowIndex[b] ? rowIndex[a] < rowIndex[b] : colIndex[a] < colIndex[b];
+  });
+
+  std::vector<cl_uint> rowPointers(rows + 1, 0);
+  std::vector<cl_uint> columnIndices;
+  std::vector<T> values;
+
+  for (size_t i = 0; i < order.size(); i++) {
+    size_t e = order[i];
+
+    bool duplicate = i > 0 && rowIndex[order[i - 1]] == rowIndex[e] && colIndex[order[i - 1]] == colIndex[e];
+    if (duplicate) {
+      values.back() += entries[e];
+      continue;
+    }
+
+    // Rows out of range are rejected by the constructor through the pointers
+    if (rowIndex[e] < rows) {
+      rowPointers[rowIndex[e] + 1]++;
+    }
+    columnIndices.push_back(colIndex[e]);
+    values.push_back(entries[e]);
+  }
+
+  std::partial_sum(rowPointers.begin(), rowPointers.end(), rowPointers.begin());
+  return SparseMatrix<T>(rows, columns, std::move(rowPointers), std::move(columnIndices), std::move(values));
+}
+
+template<typename T>
+uint SparseMatrix<T>::getMaxRowLength() const {
+  uint longest = 0;
+  for (uint row = 0; row < rows; row++) {
+    longest = std::max(longest, rowPointers[row + 1] - rowPointers[row]);
+  }
+  return longest;
+}
+
+/**
+ * Convert to ELL
+ *
+ * Output:  std::vector<cl_uint>& ellColumns - rows * width column indices, column-major
+ *          std::vector<T>& ellValues        - rows * width values, column-major
+ *          uint& width                      - the length of the longest row
+ *
+ * Entry k of a row is at k * rows + row, so neighbouring work items read
+ * neighbouring elements. Rows shorter than the width are padded.
+ */
+template<typename T>
+void SparseMatrix<T>::toEll(std::vector<cl_uint>& ellColumns, std::vector<T>& ellValues, uint& width) const {
+
+  width = getMaxRowLength();
+  ellColumns.assign((size_t)rows * width, ELL_PADDING);
+  ellValues.assign((size_t)rows * width, (T)0);
+
+  for (uint row = 0; row < rows; row++) {
+    for (cl_uint i = rowPointers[row]; i < rowPointers[row + 1]; i++) {
+      size_t index = (size_t)(i - rowPointers[row]) * rows + row;
+      ellColumns[index] = columnIndices[i];
+      ellValues[index] = values[i];
+    }
+  }
+}
+
+/**
+ * Convert to sliced ELL
+ *
+ * Output:  std::vector<cl_uint>& sliceOffsets - per slice of SLICE_HEIGHT rows the
+ *                                               offset of its entries, plus the total
+ *          std::vector<cl_uint>& ellColumns   - the column indices, column-major per slice
+ *          std::vector<T>& ellValues          - the values, column-major per slice
+ *
+ * Every slice is only padded to its own longest row, which keeps a few
+ * long rows from padding the whole matrix.
+ */
+template<typename T>
+void SparseMatrix<T>::toSlicedEll(std::vector<cl_uint>& sliceOffsets, std::vector<cl_uint>& ellColumns
+                                 , std::vector<T>& ellValues) const {
+
+  uint slices = (rows + SLICE_HEIGHT - 1) / SLICE_HEIGHT;
+  sliceOffsets.assign(slices + 1, 0);
+
+  for (uint slice = 0; slice < slices; slice++) {
+    uint width = 0;
+    for (uint row = slice * SLICE_HEIGHT; row < std::min(rows, (slice + 1) * SLICE_HEIGHT); row++) {
+      width = std::max(width, rowPointers[row + 1] - rowPointers[row]);
+    }
+    sliceOffsets[slice + 1] = sliceOffsets[slice] + width * SLICE_HEIGHT;
+  }
+
+  ellColumns.assign(sliceOffsets[slices], ELL_PADDING);
+  ellValues.assign(sliceOffsets[slices], (T)0);
+
+  for (uint row = 0; row < rows; row++) {
+    uint slice = row / SLICE_HEIGHT;
+    for (cl_uint i = rowPointers[row]; i < rowPointers[row + 1]; i++) {
+      size_t index = sliceOffsets[slice] + (size_t)(i - rowPointers[row]) * SLICE_HEIGHT + row % SLICE_HEIGHT;
+      ellColumns[index] = columnIndices[i];
+      ellValues[index] = values[i];
+    }
+  }
+}
+
+template<typename T>
+std::vector<T> SparseMatrix<T>::multiply(const std::vector<T>& x) {
+
+  if (x.size() != columns) {
+    raiseError("A vector of " + std::to_string(x.size()) + " elements does not match "
+      + std::to_string(columns) + " columns");
+  }
+
+  std::vector<T> y(rows, (T)0);
+  for (uint row = 0; row < rows; row++) {
+    for (cl_uint i = rowPointers[row]; i < rowPointers[row + 1]; i++) {
+      y[row] += values[i] * x[columnIndices[i]];
+    }
+  }
+  return y;
+}
+
+template class SparseMatrix<float>;
+template class SparseMatrix<int>;
+template class SparseMatrix<double>;
@@ -0,0 +1,134 @@
+#include "specialization.h"
+
+#include <cstdio>
+#include <regex>
+#include <vector>
+
+// Comments are dropped from the parameters, they are rewritten anyway
+static std::string stripComments(const std::string& text) {
+  static const std::regex comments("//[^\n]*|/\\*[\\s\\S]*?\\*/");
+  return std::regex_replace(text, comments, " ");
+}
+
+static std::string trim(const std::string& text) {
+  size_t first = text.find_first_not_of(" \t\r\n");
+  size_t last = text.find_last_not_of(" \t\r\n");
+  return first == std::string::npos ? "" : text.substr(first, last - first + 1);
+}
+
+/**
+ * Split a parameter list at the commas which are not nested in brackets
+ */
+static std::vector<std::string> splitParameters(const std::string& list) {
+
+  std::vector<std::string> parameters;
+  int depth = 0;
+  size_t start = 0;
+
+  for (size_t i = 0; i < list.size(); i++) {
+    char c = list[i];
+    if (c == '(' || c == '[' || c == '{') {
+      depth++;
+    } else if (c == ')' || c == ']' || c == '}') {
+      depth--;
+    } else if (c == ',' && depth == 0) {
+      parameters.push_back(trim(list.substr(start, i - start)));
+      start = i + 1;
+    }
+  }
+  parameters.push_back(trim(list.substr(start)));
+  return parameters;
+}
+
+/**
+ * Rewrite a kernel with some of its scalar arguments as constants
+ *
+ * Input:   const std::string& source   - the program, includes inlined
+ *          const std::string& entry    - the kernel function
+ *          values                      - the bytes of the scalars, by position
+ *
+ * Output:  std::string& specialized    - the rewritten program
+ *          bool                        - false when the kernel or one of the
+ *                                        parameters is not understood
+ */
+bool Specialization::rewrite(const std::string& source, const std::string& entry
+                            , const std::map<uint, std::string>& values, std::string& specialized) {
+
+  if (!std::regex_match(entry, std::regex("[A-Za-z_]\\w*"))) {
+    return false;
+  }
+
+  // __kernel [attributes] void entry(
+  std::smatch match;
+  std::regex definition("\\b(__kernel|kernel)\\b[^;{}]*?\\bvoid\\s+" + entry + "\\s*\\(");
+  if (!std::regex_search(source, match, definition)) {
+    return false;
+  }
+
+  size_t kernelStart = match.position(0);
+  size_t listStart = kernelStart + match.length(0);
+  size_t listEnd = listStart;
+  for (int depth = 1; depth > 0; listEnd++) {
+    if (listEnd >= source.size()) {
+      return false;
+    }
+    if (source[listEnd] == '(') depth++;
+    if (source[listEnd] == ')') depth--;
+  }
+  listEnd--;   // at the closing parenthesis
+
+  size_t bodyStart = source.find('{', listEnd);
+  if (bodyStart == std::string::npos) {
+    return false;
+  }
+
+  std::vector<std::string> parameters = splitParameters(stripComments(source.substr(listStart, listEnd - listStart)));
+
+  static const std::regex pointerLike("[*\\[]|\\b(__global|global|__local|local|__constant|constant|image\\w*|sampler_t)\\b");
+  static const std::regex qualifiers("\\b(const|volatile|__private|private)\\b");
+  static const std::regex lastName("([A-Za-z_]\\w*)\\s*$");
+
+  std::string constants;
+  std::string declarations;
+
+  for (auto& kv : values) {
+    uint position = kv.first;
+    const std::string& bytes = kv.second;
+
+    if (position >= parameters.size() || std::regex_search(parameters[position], pointerLike)) {
+      return false;
+    }
+
+    std::smatch name;
+    if (!std::regex_search(parameters[position], name, lastName) || name.position(0) == 0) {
+      return false;
+    }
+
+    std::string type = trim(parameters[position].substr(0, name.position(0)));
+    std::string valueType = trim(std::regex_replace(type, qualifiers, ""));
+    std::string constant = "easyopencl_constant_" + std::to_string(position);
+
+    constants += "__constant union { uchar bytes[" + std::to_string(bytes.size()) + "]; " + valueType + " value; } "
+      + constant + " = {{";
+    for (size_t i = 0; i < bytes.size(); i++) {
+      char byte[8];
+      snprintf(byte, sizeof(byte), "%s0x%02x", i ? ", " : " ", (unsigned char)bytes[i]);
+      constants += byte;
+    }
+    constants += " }};\n";
+
+    declarations += "\n  " + type + " " + name.str(1) + " = " + constant + ".value;";
+    parameters[position] = type + " easyopencl_unused_" + std::to_string(position);
+  }
+
+  std::string list;
+  for (size_t i = 0; i < parameters.size(); i++) {
+    list += (i ? ", " : "") + parameters[i];
+  }
+
+  specialized = source.substr(0, kernelStart) + constants
+    + source.substr(kernelStart, listStart - kernelStart) + list
+    + source.substr(listEnd, bodyStart + 1 - listEnd) + declarations
+    + source.substr(bodyStart + 1);
+  return true;
+}
@@ -0,0 +1,100 @@
+#include "telemetry.h"
+
+#include <sstream>
+
+/*******************************************************/
+//  Histogram
+/*******************************************************/
+void Histogram::record(uint64_t ns) {
+
+  // Index of the highest set bit
+  int bucket = 0;
+#ifdef __GNUC__
+  bucket = 63 - __builtin_clzll(ns | 1);
+#else
+  while (ns >> (bucket + 1)) { bucket++; }
+#endif
+
+  buckets[bucket]++;
+  count++;
+  total += ns;
+  if (ns < min) { min = ns; }
+  if (ns > max) { max = ns; }
+}
+
+void Histogram::reset() {
+  *this = Histogram();
+}
+
+uint64_t Histogram::getPercentile(double quantile) const {
+
+  if (count == 0) {
+    return 0;
+  }
+
+  uint64_t rank = (uint64_t)(quantile * count);
+  uint64_t seen = 0;
+
+  for (int i = 0; i < numBuckets; i++) {
+    seen += buckets[i];
+    if (seen > rank) {
+      // Never report more than the largest value recorded
+      uint64_t upper = (i == numBuckets - 1) ? UINT64_MAX : ((uint64_t)1 << (i + 1)) - 1;
+      return upper < max ? upper : max;
+    }
+  }
+  return max;
+}
+
+/*******************************************************/
+//  Telemetry
+/*******************************************************/
+void Telemetry::reset() {
+  *this = Telemetry();
+}
+
+const char * Telemetry::name(Counter c) {
+  switch (c) {
+    case Launches:          return "launches";
+    case ArgumentSets:      return "argument sets";
+    case BufferAllocations: return "buffer allocations";
+    case BytesToDevice:     return "bytes to device";
+    case BytesFromDevice:   return "bytes from device";
+    case ProgramBuilds:     return "program builds";
+    case BuffersSpilled:    return "buffers spilled";
+    case BuffersRestored:   return "buffers restored";
+    case Specializations:   return "specializations";
+    default:                return "unknown";
+  }
+}
+
+const char * Telemetry::name(Timer t) {
+  switch (t) {
+    case Evaluate:  return "evaluate";
+    case GetBuffer: return "getBuffer";
+    default:        return "unknown";
+  }
+}
+
+/**
+ * Human readable overview of all counters and timers
+ */
+std::string Telemetry::report() const {
+
+  std::stringstream out;
+
+  for (int c = 0; c < NumCounters; c++) {
+    out << name((Counter)c) << ": " << counters[c] << std::endl;
+  }
+
+  for (int t = 0; t < NumTimers; t++) {
+    const Histogram& h = timers[t];
+    out << name((Timer)t) << ": " << h.getCount() << " calls"
+        << ", mean " << h.getMean() / 1000.0 << " us"
+        << ", min " << h.getMin() / 1000.0 << " us"
+        << ", p99 < " << h.getPercentile(0.99) / 1000.0 << " us"
+        << ", max " << h.getMax() / 1000.0 << " us" << std::endl;
+  }
+
+  return out.str();
+}